@@ -12,6 +12,7 @@
 #include "ecs/components/Collider2D.h"
 #include "ecs/components/Transform2D.h"
 #include "ecs/components/HealthBar.h"
+#include "ecs/components/Hierarchy2D.h"
 #include "ecs/components/BoxCollider.h"
 #include "ecs/components/StaticSprite.h"
 #include "ecs/EcsComponentList.h"
@@ -64,12 +65,42 @@ Engine2D::Engine2D() : ecsContainer(ecs::ComponentTags{}) {
 ecs::EcsContainer& Engine2D::getEcs() { return ecsContainer; }
 
 ecs::PhysicsSystem& Engine2D::getPhysicsSystem() { return physicsSystem; }
+ecs::CollisionSystem2D& Engine2D::getCollisionSystem() {
+    return *collisionSystem;
+}
 
 Camera2D& Engine2D::getCamera() { return camera; }
 Renderer& Engine2D::getRenderer() { return *renderer; }
 
 Gui::GuiSystem& Engine2D::getGuiSystem() { return guiSystem; }
 void Engine2D::setPause(bool value) { this->paused = value; }
+void Engine2D::setDefragmentationInterval(size_t frames) {
+    defragmentationInterval = frames;
+    framesSinceDefragmentation = 0;
+}
+
+void Engine2D::setRollbackFrames(size_t frames) {
+    rollbackBuffer =
+        frames ? std::make_unique<SimulationRollback>(frames) : nullptr;
+}
+
+void Engine2D::rollback(size_t frames) {
+    if (!rollbackBuffer) {
+        throw std::runtime_error("Rollback is not enabled");
+    }
+    rollbackBuffer->restore(ecsContainer, frames);
+}
+
+void Engine2D::defragmentEcs() {
+    // entities without a transform go to the end of their storage
+    ecsContainer.defragment([this](ecs::Entity const& entity) {
+        auto* transform = ecsContainer.getComponent<Transform2D>(entity);
+        return transform ? utils::mortonCode(
+                               transform->getPosition(),
+                               EngineConstants::Ecs::defragmentationCellSize)
+                         : std::numeric_limits<uint64_t>::max();
+    });
+}
 
 void Engine2D::setControlledEntity(ecs::Entity const& entity) {
     this->controlledObj = entity;
@@ -94,6 +125,8 @@ Window& Engine2D::getWindow() { return *window; }
 
 InputHandler& Engine2D::getInputHandler() { return inputHandler; }
 ecs::AiSystem& Engine2D::getAiSystem() { return aiSystem; }
+ecs::SystemScheduler& Engine2D::getScheduler() { return scheduler; }
+ecs::CommandBuffer& Engine2D::getCommands() { return commands; }
 void Engine2D::onInit(init_fn fn) { onInitCallback = fn; }
 
 void Engine2D::onUpdate(update_fn fn) { onUpdateCallback = fn; }
@@ -193,6 +226,37 @@ void Engine2D::initializeScene() {
     Vec2 worldSize{100, 100};
     this->collisionSystem = std::make_unique<ecs::CollisionSystem2D>(worldSize);
 
+    // queues are created up front, systems may send from worker threads
+    events.get<ecs::CollisionBegan>();
+    events.get<ecs::CollisionEnded>();
+    events.get<ecs::HitboxHit>();
+    events.get<ecs::EntityDied>();
+    physicsSystem.setThreadPool(threadPool);
+    hierarchySystem.setThreadPool(threadPool);
+    collisionSystem->setThreadPool(threadPool);
+    // ai, physics, hierarchy and collision run one after the other, each
+    // moves what the next one reads; health runs next to all of them
+    scheduler.addSystem("ai", ecs::AiSystem::getAccess(),
+                        [this](scalar_t dt) { aiSystem.update(dt); });
+    scheduler.addSystem(
+        "physics", ecs::PhysicsSystem::getAccess(), [this](scalar_t dt) {
+            physicsSystem.update(*collisionSystem, ecsContainer, dt);
+        });
+    // children follow the parents moved by physics in the same frame
+    scheduler.addSystem("hierarchy", ecs::HierarchySystem::getAccess(),
+                        [this](scalar_t) {
+                            hierarchySystem.update(ecsContainer);
+                        });
+    scheduler.addSystem(
+        "collision", ecs::CollisionSystem2D::getAccess(), [this](scalar_t dt) {
+            collisionSystem->checkCollisions(ecsContainer, events, dt);
+        });
+    // deals the damage of hits sent by the collision system in the last frame
+    scheduler.addSystem("health", ecs::HealthBarSystem::getAccess(),
+                        [this](scalar_t) {
+                            healthBarSystem.applyDamage(ecsContainer, events);
+                        });
+
 #ifdef __ANDROID__
     inputHandler.addPointerMoveCallback([&](SDL_MouseMotionEvent const& e) {
         if (!ecsContainer.exists(controlledObj)) {
@@ -318,15 +382,13 @@ void Engine2D::initializeScene() {
     inputHandler.addKey(SDL_SCANCODE_P, togglePause, true);
 
     auto changeActiveObj = [&]() {
-        auto& components =
-            ecsContainer.getEntitiesWithComponents<Controller2D>();
+        auto components = ecsContainer.getEntitiesWithComponents<
+            Controller2D, ecs::Optional<Physics2D>>();
         if (components.size() == 0) return;
         std::vector<ecs::Entity> ents;
         bool found = false;
-        for (auto& [controller] : components) {
-            auto* physics =
-                ecsContainer.getComponent<Physics2D>(controller->getEntity());
-            if (!physics || (physics && !physics->isStatic())) {
+        for (auto [controller, physics] : components) {
+            if (!physics || !physics->isStatic()) {
                 ents.emplace_back(controller->getEntity());
             }
         }
@@ -351,10 +413,10 @@ void Engine2D::initializeScene() {
         float xOffset = 1;
         //-platformW/2
         float xBegin = -50 / 2 + xOffset;
-        auto& components =
+        auto components =
             ecsContainer.getEntitiesWithComponents<Physics2D, Transform2D>();
         std::cout << "Reset all, got components: " << components.size() << "\n";
-        for (auto& [physics, transform] : components) {
+        for (auto [physics, transform] : components) {
             if (!physics->isStatic()) {
                 physics->setLinearVelocity({0, 0});
                 transform->setPosition({xBegin, 5});
@@ -417,32 +479,44 @@ void Engine2D::run() {
     Mat4 projectionView;
     Mat4 ortoGuiCopy;
 
-    auto subscription = healthBarSystem.onDeadEntity(
-        [&](ecs::EcsContainer& container, ecs::Entity entity) {
-            if (entity == controlledObj) {
-                camera.detach();
-                controlledObj = {};
-            }
-            std::cout << "dead " << entity.getId() << '\n';
-            ecsContainer.removeEntity(entity);
-            std::cout << "Entities: " << ecsContainer.getCurrentEntityCount()
-                      << '\n';
-        });
-
     while (!m_quit) {
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         timeUtils.calcFPS();
         pollEvents();
         if (!paused) {
-            aiSystem.update(timeUtils.getDt());
-            physicsSystem.update(*collisionSystem, ecsContainer,
-                                 timeUtils.getDt());
-            collisionSystem->checkCollisions(ecsContainer, timeUtils.getDt());
+            scheduler.run(timeUtils.getDt());
         }
         if (onUpdateCallback) {
             onUpdateCallback(timeUtils.getDt());
         }
+        if (!paused) {
+            // events of this frame become readable, by the next frame's
+            // systems and by the handlers below
+            events.swap();
+            for (auto const& [entity] : events.read<ecs::EntityDied>()) {
+                if (entity == controlledObj) {
+                    camera.detach();
+                    controlledObj = {};
+                }
+                std::cout << "dead " << entity.getId() << '\n';
+                commands.destroyEntity(entity);
+            }
+        }
+        if (!commands.empty()) {
+            commands.apply(ecsContainer);
+            std::cout << "Entities: " << ecsContainer.getCurrentEntityCount()
+                      << '\n';
+        }
+        if (rollbackBuffer && !paused) {
+            rollbackBuffer->capture(ecsContainer);
+        }
+        // between frames, nothing holds component pointers
+        if (defragmentationInterval &&
+            ++framesSinceDefragmentation >= defragmentationInterval) {
+            framesSinceDefragmentation = 0;
+            defragmentEcs();
+        }
         camera.updatePosition(ecsContainer);
         projectionView = ortoCenter * camera.worldToView();
         ortoGuiCopy = ortoGui;
@@ -1,6 +1,10 @@
 #pragma once
 #include "Window.h"
 #include "ecs/components/Camera2D.h"
+#include "ecs/components/AnimatedSprite.h"
+#include "ecs/components/Controller2D.h"
+#include "ecs/components/Physics2D.h"
+#include "ecs/components/Transform2D.h"
 #include "TimeUtils.h"
 #include "InputHandler.h"
 #include "Utils.h"
@@ -15,6 +19,12 @@
 #include "ecs/systems/SpriteSystem.h"
 #include "ecs/systems/GuiSystem.h"
 #include "ecs/systems/AiSystem.h"
+#include "ecs/systems/HierarchySystem.h"
+#include "ecs/SystemScheduler.h"
+#include "ecs/CommandBuffer.h"
+#include "ecs/EventBus.h"
+#include "ecs/RollbackBuffer.h"
+#include "ThreadPool.h"
 #include "opengl/Shader.h"
 #include <memory>
 #include <functional>
@@ -34,8 +44,12 @@ class Engine2D {
     ecs::EcsContainer& getEcs();
     AssetsManager& getAssetsManager();
     ecs::PhysicsSystem& getPhysicsSystem();
+    ecs::CollisionSystem2D& getCollisionSystem();
     Gui::GuiSystem& getGuiSystem();
     ecs::AiSystem& getAiSystem();
+    ecs::SystemScheduler& getScheduler();
+    // structural changes recorded during the frame, applied after it
+    ecs::CommandBuffer& getCommands();
     Camera2D& getCamera();
     Renderer& getRenderer();
     Shader& getShader(ShaderType type);
@@ -45,6 +59,15 @@ class Engine2D {
     void onUpdate(update_fn fn);
     void onWindowSizeChange(window_event_fn fn);
     void setPause(bool value);
+    // every given number of frames components are sorted by the Morton code of
+    // their position, 0 disables it
+    void setDefragmentationInterval(size_t frames);
+    // keeps the simulated components of the given number of last frames, 0
+    // disables it
+    void setRollbackFrames(size_t frames);
+    // restores the simulated components as they were the given number of
+    // frames ago
+    void rollback(size_t frames);
     void setControlledEntity(ecs::Entity const& entity);
     void setOrto(scalar_t left, scalar_t right, scalar_t bottom, scalar_t top);
     void quit();
@@ -70,6 +93,16 @@ class Engine2D {
     InputHandler inputHandler;
     TimeUtils timeUtils;
     ecs::PhysicsSystem physicsSystem;
+    ecs::HierarchySystem hierarchySystem;
+    ThreadPool threadPool;
+    ecs::SystemScheduler scheduler{threadPool};
+    // structural changes requested while systems iterate
+    ecs::CommandBuffer commands;
+    ecs::EventBus events;
+    using SimulationRollback =
+        ecs::RollbackBuffer<Transform2D, Physics2D, Controller2D,
+                            ecs::AnimatedSprite>;
+    std::unique_ptr<SimulationRollback> rollbackBuffer;
     utils::RandomMatrix<scalar_t>& randMatrix =
         utils::RandomMatrix<scalar_t>::instance();
     bool m_quit = false;
@@ -84,5 +117,8 @@ class Engine2D {
     bool vfxEnabled = true;
     bool vsyncEnabled = true;
     bool paused = false;
+    size_t defragmentationInterval = 0;
+    size_t framesSinceDefragmentation = 0;
     void pollEvents();
+    void defragmentEcs();
 };
\ No newline at end of file
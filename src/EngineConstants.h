@@ -31,4 +31,8 @@ inline int constexpr mediumSize = 24;
 inline int constexpr bigSize = 36;
 inline std::string const defaultFont = "Rokkitt-Regular.ttf";
 }  // namespace Font
+namespace Ecs {
+// size of a Morton code cell used when sorting components by position
+inline scalar_t constexpr defragmentationCellSize = 1;
+}  // namespace Ecs
 }  // namespace EngineConstants
\ No newline at end of file
@@ -0,0 +1,97 @@
+#include "ThreadPool.h"
+
+namespace {
+// lets submit() push to the queue of the worker it is called from
+thread_local ThreadPool const* currentPool = nullptr;
+thread_local size_t currentWorker = 0;
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threadCount) {
+    threadCount = std::max<size_t>(threadCount, 1);
+    queues.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        queues.emplace_back(std::make_unique<WorkQueue>());
+    }
+    workers.reserve(threadCount);
+    for (size_t i = 0; i < threadCount; ++i) {
+        workers.emplace_back([this, i] { work(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(task_fn task) {
+    auto queue = currentPool == this
+                     ? currentWorker
+                     : nextQueue.fetch_add(1) % queues.size();
+    {
+        // counted under the lock so a worker going to sleep cannot miss it,
+        // and before pushing so a worker taking the task never underflows it
+        std::lock_guard lock(mutex);
+        ++queued;
+    }
+    {
+        std::lock_guard lock(queues[queue]->mutex);
+        queues[queue]->tasks.emplace_back(std::move(task));
+    }
+    condition.notify_one();
+}
+
+size_t ThreadPool::getThreadCount() const { return workers.size(); }
+
+size_t ThreadPool::defaultThreadCount() {
+    auto hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+}
+
+bool ThreadPool::tryPop(size_t queue, task_fn& task) {
+    auto& own = *queues[queue];
+    std::lock_guard lock(own.mutex);
+    if (own.tasks.empty()) {
+        return false;
+    }
+    task = std::move(own.tasks.back());
+    own.tasks.pop_back();
+    return true;
+}
+
+bool ThreadPool::trySteal(size_t thief, task_fn& task) {
+    for (size_t i = 1; i < queues.size(); ++i) {
+        auto& victim = *queues[(thief + i) % queues.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::work(size_t index) {
+    currentPool = this;
+    currentWorker = index;
+    while (true) {
+        task_fn task;
+        if (tryPop(index, task) || trySteal(index, task)) {
+            --queued;
+            task();
+            continue;
+        }
+        std::unique_lock lock(mutex);
+        condition.wait(lock, [this] { return stopping || queued > 0; });
+        // remaining tasks are finished before exiting
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+Every worker owns a queue. Tasks submitted from a worker go to its own queue
+and are taken newest first, idle workers steal the oldest tasks of the others.
+*/
+class ThreadPool {
+   public:
+    using task_fn = std::function<void()>;
+
+    // defaults to one worker per hardware thread except the calling one
+    explicit ThreadPool(size_t threadCount = defaultThreadCount());
+    ~ThreadPool();
+    ThreadPool(ThreadPool const&) = delete;
+    ThreadPool& operator=(ThreadPool const&) = delete;
+
+    void submit(task_fn task);
+    // calls fn(begin, end) for ranges of at most grainSize indices and returns
+    // once all of them are done; the calling thread takes part in the work
+    template <typename Fn>
+    void parallelFor(size_t count, size_t grainSize, Fn&& fn);
+    size_t getThreadCount() const;
+    static size_t defaultThreadCount();
+
+   private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<task_fn> tasks;
+    };
+
+    bool tryPop(size_t queue, task_fn& task);
+    bool trySteal(size_t thief, task_fn& task);
+    void work(size_t index);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::atomic<size_t> queued = 0;
+    std::atomic<size_t> nextQueue = 0;
+    bool stopping = false;
+};
+
+template <typename Fn>
+void ThreadPool::parallelFor(size_t count, size_t grainSize, Fn&& fn) {
+    grainSize = std::max<size_t>(grainSize, 1);
+    size_t rangeCount = (count + grainSize - 1) / grainSize;
+    if (rangeCount <= 1) {
+        if (count > 0) {
+            fn(size_t{0}, count);
+        }
+        return;
+    }
+    struct State {
+        std::atomic<size_t> next = 0;
+        size_t finished = 0;
+        std::mutex mutex;
+        std::condition_variable done;
+        std::exception_ptr error;
+    };
+    // helpers can start after parallelFor returned, they only touch the
+    // shared state then, never fn
+    auto state = std::make_shared<State>();
+    auto runRanges = [state, rangeCount, count, grainSize, &fn] {
+        size_t finished = 0;
+        std::exception_ptr error;
+        for (auto range = state->next++; range < rangeCount;
+             range = state->next++) {
+            auto begin = range * grainSize;
+            try {
+                fn(begin, std::min(begin + grainSize, count));
+            } catch (...) {
+                error = std::current_exception();
+            }
+            ++finished;
+        }
+        if (finished > 0) {
+            std::lock_guard lock(state->mutex);
+            state->finished += finished;
+            if (error && !state->error) {
+                state->error = error;
+            }
+            state->done.notify_one();
+        }
+    };
+    auto helpers = std::min(workers.size(), rangeCount - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit(runRanges);
+    }
+    runRanges();
+    std::unique_lock lock(state->mutex);
+    state->done.wait(lock, [&] { return state->finished == rangeCount; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
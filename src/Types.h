@@ -35,10 +35,29 @@ template <typename... Ts>
 struct TypeSequence {};
 
 namespace ecs {
-using EntityId = size_t;  // index
-using EntityVersion = size_t;
-using ComponentSig = uint64_t;
+// an entity handle packs an index and a generation into one integer, 32 bits
+// by default with 22 of them for the index
+#ifdef ECS_ENTITY_HANDLE_64
+using EntityHandle = uint64_t;
+#else
+using EntityHandle = uint32_t;
+#endif
+#ifdef ECS_ENTITY_INDEX_BITS
+inline constexpr size_t ENTITY_INDEX_BITS = ECS_ENTITY_INDEX_BITS;
+#else
+inline constexpr size_t ENTITY_INDEX_BITS = sizeof(EntityHandle) == 8 ? 32 : 22;
+#endif
+inline constexpr size_t ENTITY_VERSION_BITS =
+    sizeof(EntityHandle) * 8 - ENTITY_INDEX_BITS;
+using EntityId = EntityHandle;  // index
+using EntityVersion = EntityHandle;
 using ComponentId = size_t;
+// width of ComponentSig, a multiple of 64
+#ifdef ECS_MAX_COMPONENT_TYPES
+inline constexpr size_t MAX_COMPONENT_TYPES = ECS_MAX_COMPONENT_TYPES;
+#else
+inline constexpr size_t MAX_COMPONENT_TYPES = 128;
+#endif
 
 }  // namespace ecs
 namespace Engine {
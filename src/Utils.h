@@ -7,6 +7,9 @@
 #include <SDL2/SDL.h>
 #include <chrono>
 #include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
 
 #if HAS_CONCEPTS
 #include <concepts>
@@ -120,6 +123,27 @@ inline unsigned nextPowerOfTwo(unsigned value) {
     return result;
 }
 
+// interleaves the bits of the cell coordinates of a position, positions close
+// to each other in space mostly get close codes
+inline uint64_t mortonCode(Vec2 const& position, scalar_t cellSize = 1) {
+    auto cell = [cellSize](scalar_t value) {
+        auto c = std::clamp<double>(std::floor(value / cellSize), INT32_MIN,
+                                    INT32_MAX);
+        // flipping the sign bit orders negative cells before positive ones
+        return static_cast<uint64_t>(static_cast<uint32_t>(
+                   static_cast<int32_t>(c)) ^ 0x80000000u);
+    };
+    auto spread = [](uint64_t v) {
+        v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+        v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+        v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+        v = (v | (v << 2)) & 0x3333333333333333ull;
+        v = (v | (v << 1)) & 0x5555555555555555ull;
+        return v;
+    };
+    return spread(cell(position[0])) | (spread(cell(position[1])) << 1);
+}
+
 // defines screen coordinate system and maps to a square <-1,1> by <-1,1>
 inline Mat4 ortographicProjection(scalar_t left, scalar_t right,
                                   scalar_t bottom, scalar_t top) {
@@ -0,0 +1,149 @@
+#pragma once
+#include "EcsContainer.h"
+#include <algorithm>
+#include <array>
+#include <vector>
+
+namespace ecs {
+/*
+Records structural changes and applies them to a container later in one
+batch, e.g. after all systems are done iterating. Not thread safe: systems
+running in parallel should record into their own buffers.
+
+Operations are applied by kind rather than in the recorded order: created
+entities first, then removed components and added components, both grouped by
+component type, destroyed entities last. Queries touched by the batch are
+invalidated once instead of being updated for every change.
+*/
+class CommandBuffer {
+   public:
+    CommandBuffer() = default;
+    ~CommandBuffer();
+    CommandBuffer(CommandBuffer const&) = delete;
+    CommandBuffer& operator=(CommandBuffer const&) = delete;
+
+    // placeholder valid only as an argument to this buffer until apply()
+    Entity createEntity();
+    void destroyEntity(Entity const& entity);
+    template <typename Component, typename... Args>
+    void addComponent(Entity const& entity, Args&&... args);
+    template <typename Component>
+    void removeComponent(Entity const& entity);
+    // returns the created entities in the order of createEntity calls
+    std::vector<Entity> apply(EcsContainer& container);
+    bool empty() const;
+    void clear();
+
+   private:
+    // components constructed at record time, moved into the container
+    struct PendingComponents {
+        using add_fn = void (*)(EcsContainer&, Entity const&, byte*);
+        EcsContainerBuffer<byte> components;
+        std::vector<Entity> entities;
+        add_fn add = nullptr;
+    };
+
+    static bool isPending(Entity const& entity);
+    static Entity resolve(Entity const& entity,
+                          std::vector<Entity> const& created);
+
+    size_t createdCount = 0;
+    std::array<PendingComponents, MAX_COMPONENT_TYPES> added;
+    std::vector<std::pair<ComponentId, Entity>> removed;
+    std::vector<Entity> destroyed;
+    ComponentSig addedTypes;
+};
+
+inline constexpr EntityVersion PENDING_ENTITY_VERSION =
+    INVALID_ENTITY_VERSION - 1;
+
+inline CommandBuffer::~CommandBuffer() { clear(); }
+
+inline Entity CommandBuffer::createEntity() {
+    return Entity(createdCount++, PENDING_ENTITY_VERSION);
+}
+
+inline void CommandBuffer::destroyEntity(Entity const& entity) {
+    destroyed.emplace_back(entity);
+}
+
+template <typename Component, typename... Args>
+inline void CommandBuffer::addComponent(Entity const& entity, Args&&... args) {
+    constexpr ComponentId cId = utils::getTypeIndexFromSequence<
+        typename Component::single_tag>(typename Component::all_tags());
+    auto& pending = added[cId];
+    if (!pending.add) {
+        pending.add = [](EcsContainer& container, Entity const& entity,
+                         byte* component) {
+            container.addComponent<Component>(
+                entity, std::move(*reinterpret_cast<Component*>(component)));
+        };
+    }
+    pending.components.emplace_back<Component>(std::forward<Args>(args)...);
+    pending.entities.emplace_back(entity);
+    addedTypes.set(cId);
+}
+
+template <typename Component>
+inline void CommandBuffer::removeComponent(Entity const& entity) {
+    constexpr ComponentId cId = utils::getTypeIndexFromSequence<
+        typename Component::single_tag>(typename Component::all_tags());
+    removed.emplace_back(cId, entity);
+}
+
+inline std::vector<Entity> CommandBuffer::apply(EcsContainer& container) {
+    std::vector<Entity> created;
+    created.reserve(createdCount);
+    container.beginBatch();
+    for (size_t i = 0; i < createdCount; ++i) {
+        created.emplace_back(container.createEntity());
+    }
+    std::stable_sort(removed.begin(), removed.end(),
+                     [](auto const& a, auto const& b) {
+                         return a.first < b.first;
+                     });
+    for (auto const& [cId, entity] : removed) {
+        container.removeComponentImpl(resolve(entity, created), cId);
+    }
+    for (auto cId : addedTypes) {
+        auto& pending = added[cId];
+        for (size_t i = 0; i < pending.entities.size(); ++i) {
+            pending.add(container, resolve(pending.entities[i], created),
+                        &pending.components[i]);
+        }
+    }
+    for (auto& entity : destroyed) {
+        entity = resolve(entity, created);
+    }
+    container.removeEntities(destroyed);
+    container.endBatch();
+    clear();
+    return created;
+}
+
+inline bool CommandBuffer::empty() const {
+    return createdCount == 0 && addedTypes.none() && removed.empty() &&
+           destroyed.empty();
+}
+
+inline void CommandBuffer::clear() {
+    for (auto cId : addedTypes) {
+        auto& pending = added[cId];
+        pending.components.clear();  // destroys moved-from components
+        pending.entities.clear();
+    }
+    addedTypes = {};
+    createdCount = 0;
+    removed.clear();
+    destroyed.clear();
+}
+
+inline bool CommandBuffer::isPending(Entity const& entity) {
+    return entity.getVersion() == PENDING_ENTITY_VERSION;
+}
+
+inline Entity CommandBuffer::resolve(Entity const& entity,
+                                     std::vector<Entity> const& created) {
+    return isPending(entity) ? created[entity.getId()] : entity;
+}
+}  // namespace ecs
@@ -0,0 +1,230 @@
+#pragma once
+#include "../Types.h"
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace ecs {
+/*
+Fixed size set of component ids stored in 64 bit words. Subset tests, used when
+matching entity signatures against queries, compare 128 or 256 bits at once
+when SSE2 or AVX2 is available.
+*/
+template <size_t Bits>
+class Signature {
+    static_assert(Bits > 0 && Bits % 64 == 0,
+                  "Signature size has to be a multiple of 64 bits");
+
+   public:
+    static constexpr size_t WORD_COUNT = Bits / 64;
+
+    // walks over the ids of set bits in ascending order
+    class Iterator {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = ComponentId;
+        using reference = value_type;
+
+        constexpr Iterator() = default;
+        constexpr explicit Iterator(Signature const& signature)
+            : words(&signature.words), word(0), bits(signature.words[0]) {
+            skipEmptyWords();
+        }
+        constexpr reference operator*() const noexcept {
+            return word * 64 + std::countr_zero(bits);
+        }
+        constexpr Iterator& operator++() noexcept {
+            bits &= bits - 1;
+            skipEmptyWords();
+            return *this;
+        }
+        constexpr Iterator operator++(int) noexcept {
+            auto tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+        constexpr bool operator==(Iterator const& o) const noexcept {
+            return word == o.word && bits == o.bits;
+        }
+        constexpr bool operator!=(Iterator const& o) const noexcept {
+            return !(*this == o);
+        }
+
+       private:
+        constexpr void skipEmptyWords() noexcept {
+            while (bits == 0 && ++word < WORD_COUNT) {
+                bits = (*words)[word];
+            }
+            if (bits == 0) {
+                word = WORD_COUNT;
+            }
+        }
+
+        std::array<uint64_t, WORD_COUNT> const* words = nullptr;
+        size_t word = WORD_COUNT;
+        uint64_t bits = 0;
+    };
+
+    constexpr Signature() = default;
+
+    static constexpr Signature bit(size_t i) noexcept {
+        Signature signature;
+        signature.set(i);
+        return signature;
+    }
+    static constexpr Signature all() noexcept { return ~Signature(); }
+
+    constexpr Signature& set(size_t i) noexcept {
+        words[i / 64] |= uint64_t{1} << (i % 64);
+        return *this;
+    }
+    constexpr Signature& reset(size_t i) noexcept {
+        words[i / 64] &= ~(uint64_t{1} << (i % 64));
+        return *this;
+    }
+    constexpr bool test(size_t i) const noexcept {
+        return (words[i / 64] >> (i % 64)) & 1;
+    }
+    constexpr bool any() const noexcept {
+        uint64_t bits = 0;
+        for (auto word : words) {
+            bits |= word;
+        }
+        return bits != 0;
+    }
+    constexpr bool none() const noexcept { return !any(); }
+    constexpr explicit operator bool() const noexcept { return any(); }
+    constexpr size_t count() const noexcept {
+        size_t count = 0;
+        for (auto word : words) {
+            count += std::popcount(word);
+        }
+        return count;
+    }
+    // lowest set id, Bits if none is set
+    constexpr size_t first() const noexcept {
+        return any() ? *begin() : Bits;
+    }
+
+    // true if every bit set in o is also set here
+    bool contains(Signature const& o) const noexcept;
+    constexpr bool intersects(Signature const& o) const noexcept {
+        return (*this & o).any();
+    }
+
+    constexpr Iterator begin() const noexcept { return Iterator(*this); }
+    constexpr Iterator end() const noexcept { return Iterator(); }
+
+    constexpr Signature& operator&=(Signature const& o) noexcept {
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            words[i] &= o.words[i];
+        }
+        return *this;
+    }
+    constexpr Signature& operator|=(Signature const& o) noexcept {
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            words[i] |= o.words[i];
+        }
+        return *this;
+    }
+    constexpr Signature& operator^=(Signature const& o) noexcept {
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            words[i] ^= o.words[i];
+        }
+        return *this;
+    }
+    constexpr Signature operator~() const noexcept {
+        Signature result;
+        for (size_t i = 0; i < WORD_COUNT; ++i) {
+            result.words[i] = ~words[i];
+        }
+        return result;
+    }
+    friend constexpr Signature operator&(Signature a,
+                                         Signature const& b) noexcept {
+        return a &= b;
+    }
+    friend constexpr Signature operator|(Signature a,
+                                         Signature const& b) noexcept {
+        return a |= b;
+    }
+    friend constexpr Signature operator^(Signature a,
+                                         Signature const& b) noexcept {
+        return a ^= b;
+    }
+    friend constexpr bool operator==(Signature const& a,
+                                     Signature const& b) noexcept {
+        return a.words == b.words;
+    }
+    friend constexpr bool operator!=(Signature const& a,
+                                     Signature const& b) noexcept {
+        return !(a == b);
+    }
+
+    constexpr uint64_t getWord(size_t i) const noexcept { return words[i]; }
+
+   private:
+    std::array<uint64_t, WORD_COUNT> words{};
+};
+
+template <size_t Bits>
+inline bool Signature<Bits>::contains(Signature const& o) const noexcept {
+#if defined(__AVX2__)
+    if constexpr (WORD_COUNT % 4 == 0) {
+        int contained = 1;
+        for (size_t i = 0; i < WORD_COUNT; i += 4) {
+            auto a = _mm256_loadu_si256(
+                reinterpret_cast<__m256i const*>(&words[i]));
+            auto b = _mm256_loadu_si256(
+                reinterpret_cast<__m256i const*>(&o.words[i]));
+            // carry flag: no bit of b outside of a
+            contained &= _mm256_testc_si256(a, b);
+        }
+        return contained;
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    if constexpr (WORD_COUNT % 2 == 0) {
+        auto missing = _mm_setzero_si128();
+        for (size_t i = 0; i < WORD_COUNT; i += 2) {
+            auto a =
+                _mm_loadu_si128(reinterpret_cast<__m128i const*>(&words[i]));
+            auto b =
+                _mm_loadu_si128(reinterpret_cast<__m128i const*>(&o.words[i]));
+            missing = _mm_or_si128(missing, _mm_andnot_si128(a, b));
+        }
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(
+                   missing, _mm_setzero_si128())) == 0xFFFF;
+    }
+#endif
+    uint64_t missing = 0;
+    for (size_t i = 0; i < WORD_COUNT; ++i) {
+        missing |= o.words[i] & ~words[i];
+    }
+    return missing == 0;
+}
+
+using ComponentSig = Signature<MAX_COMPONENT_TYPES>;
+}  // namespace ecs
+
+template <size_t Bits>
+struct std::hash<ecs::Signature<Bits>> {
+    size_t operator()(ecs::Signature<Bits> const& signature) const noexcept {
+        size_t seed = 0;
+        for (size_t i = 0; i < ecs::Signature<Bits>::WORD_COUNT; ++i) {
+            seed ^= std::hash<uint64_t>{}(signature.getWord(i)) +
+                    0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+        }
+        return seed;
+    }
+};
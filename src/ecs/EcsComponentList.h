@@ -11,10 +11,12 @@ struct HealthBarTag {};
 struct StaticSpriteTag {};
 struct AnimatedSpriteTag {};
 struct AnimationTag {};
+struct Hierarchy2DTag {};
 
 // order in the list defines layout in memory
 using ComponentTags =
     TypeSequence<Transform2DTag, Physics2DTag, StaticSpriteTag,
                  AnimatedSpriteTag, Controller2DTag, Graphics2DTag,
-                 Collider2DTag, AnimationTag, HealthBarTag>;
+                 Collider2DTag, AnimationTag, HealthBarTag,
+                 Hierarchy2DTag>;
 }  // namespace ecs
@@ -1,6 +1,8 @@
 #pragma once
 #include "../TemplateUtils.h"
 #include "../Types.h"
+#include "ComponentSig.h"
+#include "../ThreadPool.h"
 #include <algorithm>
 #include <stdexcept>
 #include <limits>
@@ -8,40 +10,96 @@
 #include <string>
 #include <tuple>
 #include <array>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <type_traits>
+#include <mutex>
+#include <span>
+#include <atomic>
 
 namespace ecs {
-template <typename T>
-byte* getAlignedAddress(byte* memory) {
+// component storage starts at cache line boundaries, so ranges handed to
+// different threads by parallelForEach never share a line
+inline constexpr size_t CACHE_LINE_SIZE = 64;
+// bytes of components processed by one task in parallelForEach
+inline constexpr size_t PARALLEL_RANGE_SIZE = 16 * 1024;
+
+inline byte* getAlignedAddress(byte* memory, size_t alignment) {
     uintptr_t addr = reinterpret_cast<uintptr_t>(memory);
-    uintptr_t alignedAddr = (addr + alignof(T) - 1) & ~(alignof(T) - 1);
+    uintptr_t alignedAddr = (addr + alignment - 1) & ~(alignment - 1);
     return reinterpret_cast<byte*>(alignedAddr);
 }
 
+template <typename T>
+byte* getAlignedAddress(byte* memory) {
+    return getAlignedAddress(memory, alignof(T));
+}
+
 class ComponentManager;
 class EntityManager;
 class MovableBase;
+class EcsContainer;
+class CommandBuffer;
+class WorldSnapshot;
+
+// COMPONENT_ARRAYS: every component type lives in its own buffer.
+// ARCHETYPE_CHUNKS: entities with the same signature share fixed-size chunks,
+// each component type is a contiguous column inside a chunk.
+enum class StorageMode { COMPONENT_ARRAYS, ARCHETYPE_CHUNKS };
+
+#ifdef ECS_ARCHETYPE_STORAGE
+inline constexpr StorageMode DEFAULT_STORAGE_MODE =
+    StorageMode::ARCHETYPE_CHUNKS;
+#else
+inline constexpr StorageMode DEFAULT_STORAGE_MODE =
+    StorageMode::COMPONENT_ARRAYS;
+#endif
+
+/*
+Change ticks. Components stamp themselves with the current tick when added and
+when they call markChanged(). A system remembers the tick returned by
+advanceTick() at the start of its run and on the next run looks only at
+components stamped after it, which includes its own writes of the last run.
+The counter is shared by all containers, so components can stamp themselves
+without knowing their container, and wraps around safely.
+*/
+using Tick = uint32_t;
+Tick getCurrentTick() noexcept;
+// returns the tick before advancing, e.g.
+// auto since = std::exchange(lastRun, advanceTick());
+Tick advanceTick() noexcept;
+// true if tick is later than since, also across a wrap around
+constexpr bool isNewerTick(Tick tick, Tick since) noexcept {
+    return static_cast<int32_t>(tick - since) > 0;
+}
 
+// index in the low bits, generation in the high bits of one EntityHandle
 class Entity final {
-    friend class EntityManager;
-    friend class ComponentManager;
-    friend class MovableBase;
-
    public:
+    static constexpr EntityHandle INDEX_MASK =
+        (EntityHandle{1} << ENTITY_INDEX_BITS) - 1;
+    static constexpr EntityHandle VERSION_MASK =
+        (EntityHandle{1} << ENTITY_VERSION_BITS) - 1;
+
     Entity();
     Entity(EntityId id, EntityVersion version);
     EntityId getId() const;
     EntityVersion getVersion() const;
+    EntityHandle getHandle() const;
 
    private:
-    EntityId id;
-    EntityVersion version;
+    EntityHandle handle;
 };
+static_assert(ENTITY_INDEX_BITS > 0 && ENTITY_VERSION_BITS > 1,
+              "Entity handle needs index and generation bits");
 
 inline bool operator==(Entity const& a, Entity const& b) {
-    return (a.getId() == b.getId()) && (a.getVersion() == b.getVersion());
+    return a.getHandle() == b.getHandle();
 }
 inline bool operator!=(Entity const& a, Entity const& b) {
-    return (a.getId() != b.getId()) || (a.getVersion() != b.getVersion());
+    return a.getHandle() != b.getHandle();
 }
 inline bool operator<(Entity const& a, Entity const& b) {
     return a.getId() < b.getId();
@@ -62,11 +120,36 @@ class MovableBase {
 
     Entity const& getEntity() const noexcept;
     virtual void moveTo(byte* destination) = 0;
+    Tick getAddedTick() const noexcept;
+    Tick getChangedTick() const noexcept;
+    bool addedSince(Tick since) const noexcept;
+    bool changedSince(Tick since) const noexcept;
+    // components call it after modifying their own state
+    void markChanged() noexcept;
 
    private:
+    // binds a component to its entity when added to a container
+    void attach(Entity const& owner) noexcept;
+
     Entity entity;
+    Tick addedTick = 0;
+    Tick changedTick = 0;
 };
 
+/*
+Components declaring `static constexpr bool trivially_relocatable = true;`
+are moved around storage with memcpy instead of moveTo and a destructor call.
+Only valid if move constructing a copy and destroying the source is
+equivalent to copying the bytes, e.g. no self-referencing pointers.
+*/
+template <typename Component, typename = void>
+struct IsTriviallyRelocatable : std::false_type {};
+
+template <typename Component>
+struct IsTriviallyRelocatable<
+    Component, std::void_t<decltype(Component::trivially_relocatable)>>
+    : std::bool_constant<Component::trivially_relocatable> {};
+
 struct EcsContainerBufferBase {
     virtual ~EcsContainerBufferBase() = default;
 };
@@ -80,12 +163,14 @@ class EcsContainerBuffer final : public EcsContainerBufferBase {
     EcsContainerBuffer() = default;
     ~EcsContainerBuffer() noexcept;
     EcsContainerBuffer(EcsContainerBuffer const&) = delete;
-    EcsContainerBuffer(EcsContainerBuffer&&) = default;
+    EcsContainerBuffer(EcsContainerBuffer&& o) noexcept;
     EcsContainerBuffer& operator=(EcsContainerBuffer const&) = delete;
-    EcsContainerBuffer& operator=(EcsContainerBuffer&&) = default;
+    EcsContainerBuffer& operator=(EcsContainerBuffer&& o) noexcept;
     size_t size() const noexcept;
     size_t capacity() const noexcept;
     void pop_back() noexcept;
+    // drops the last element without destroying it, used after relocating it
+    void releaseBack() noexcept;
     T* data() const noexcept;
     T* data() noexcept;
     T& back() noexcept;
@@ -95,6 +180,8 @@ class EcsContainerBuffer final : public EcsContainerBufferBase {
     S* castBack() const noexcept;
     bool empty() const noexcept;
     void resize(size_t newSize);
+    template <typename S = T>
+    void reserve(size_t newCapacity);
     size_t typeSize() const noexcept;
     utils::Iterator<T> begin() noexcept;
     utils::Iterator<T> end() noexcept;
@@ -124,27 +211,112 @@ class EcsContainerBuffer final : public EcsContainerBufferBase {
     byte* m_buffer = nullptr;
 };
 
+/*
+Maps entity ids to indices of their components in the dense array of one
+component type. Pages are allocated on first use and released once empty, so
+memory grows with the entities owning the component instead of all ids.
+*/
+class SparseIndex final {
+   public:
+    using index_type = uint32_t;
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr index_type INVALID_INDEX =
+        std::numeric_limits<index_type>::max();
+
+    index_type get(EntityId id) const noexcept;
+    void set(EntityId id, index_type index);
+    void erase(EntityId id) noexcept;
+    size_t pageCount() const noexcept;
+
+   private:
+    struct Page {
+        std::array<index_type, PAGE_SIZE> indices;
+        size_t count = 0;
+    };
+    std::vector<std::unique_ptr<Page>> pages;
+};
+
+struct Relocation {
+    EntityId entity = 0;
+    ComponentSig components;
+};
+
+// components moved in memory by the last structural change
+struct ComponentRelocations {
+    EcsContainerBuffer<Relocation> moved;
+};
+
+/*
+Cached query results. With component arrays every matching entity has a row of
+indices into the buffers of the queried types. Rows are kept up to date
+incrementally: an entity gaining or losing a component inserts or swap-removes
+only its own row, rows of components that moved inside a buffer are rewritten
+in place. Indices, unlike pointers, survive buffers growing. With archetype
+chunks only the list of matching archetypes is cached.
+*/
 struct QueryCacheEntry {
-    std::array<byte, 64> byteSig{};
-    ComponentSig bitSig = 0;
-    void* buffer = nullptr;
-    bool dirty = false;
+    using index_type = SparseIndex::index_type;
+    // entity id is not cached when its position is 0, otherwise index + 1
+    static constexpr size_t NOT_CACHED = 0;
+
+    bool matches(ComponentSig const& signature) const noexcept;
+
+    ComponentSig bitSig;  // required components
+    ComponentSig excludedSig;
+    ComponentSig optionalSig;
+    // ids of yielded components in the order of the query, rows of optional
+    // ones hold SparseIndex::INVALID_INDEX for entities without them
+    std::array<ComponentId, MAX_COMPONENT_TYPES> columns{};
+    size_t columnCount = 0;
+    EcsContainerBuffer<index_type> rows;  // columnCount indices per entity
+    EcsContainerBuffer<Entity> entities;  // owner of each row
+    EcsContainerBuffer<size_t> positions;
+    std::vector<size_t> archetypes;
+    size_t scannedArchetypes = 0;
+    bool dirty = true;  // rebuilt before the next use
+};
+
+using QueryId = size_t;
+// dense id of a query, one per list of component types in every container,
+// assigned on first use
+template <typename... Components>
+QueryId getQueryId() noexcept;
+
+// signatures of a query, column positions start at 1, 0 if not yielded
+struct QuerySignature {
+    ComponentSig required;
+    ComponentSig excluded;
+    ComponentSig optional;
+    std::array<byte, MAX_COMPONENT_TYPES> columns{};
 };
 
 class ComponentQueryCache {
    public:
-    using sig_t = std::pair<ComponentSig, std::array<byte, 64>>;
-    template <typename... Components>
-    size_t createCache(sig_t const& sig);
-    template <typename TupleType>
-    void addTuple(size_t index, TupleType const& cTuple);
-    std::pair<size_t, QueryCacheEntry*> find(sig_t const& sig);
-    void purge(ComponentId const& cId);
-    QueryCacheEntry& operator[](size_t i);
-    ~ComponentQueryCache();
+    using sig_t = QuerySignature;
+    // entries are never moved, views keep pointers to them
+    QueryCacheEntry& createCache(QueryId id, sig_t const& sig);
+    QueryCacheEntry* find(QueryId id) const noexcept;
+    void insert(QueryCacheEntry& entry, ComponentManager const& manager,
+                Entity const& entity);
+    void clear(QueryCacheEntry& entry);
+    void update(ComponentManager const& manager, Entity const& entity,
+                ComponentSig oldSig, ComponentSig newSig,
+                ComponentRelocations const& relocations);
+    void purge(ComponentSig const& changed);
 
    private:
-    EcsContainerBuffer<QueryCacheEntry> cache;
+    static bool contains(QueryCacheEntry const& entry, EntityId id);
+    // writes indices of the components of an entity to the row at index,
+    // appends if index is equal to the number of rows
+    static void writeRow(QueryCacheEntry& entry,
+                         ComponentManager const& manager, size_t index,
+                         EntityId id);
+    void erase(QueryCacheEntry& entry, EntityId id);
+    void refresh(QueryCacheEntry& entry, ComponentManager const& manager,
+                 EntityId id);
+
+    std::vector<std::unique_ptr<QueryCacheEntry>> cache;
+    std::vector<QueryCacheEntry*> slots;  // indexed by QueryId
 };
 
 class EntityManager final {
@@ -156,39 +328,273 @@ class EntityManager final {
     size_t getCurrentEntityCount() const;
     size_t getMaximumEntityCount() const;
     Entity const& operator[](size_t index) const;
+    EntityId getFirstFree() const;
+    size_t getFreeCount() const;
+    // replaces all slots, live and free, e.g. when loading a snapshot
+    void restore(std::span<Entity const> slots, EntityId firstFree,
+                 size_t freeCount);
 
    private:
+    // a free slot holds the index of the next free one and the generation
+    // its next entity gets
     EcsContainerBuffer<Entity> entities;
-    EcsContainerBuffer<EntityId> removedIds;
-    EcsContainerBuffer<EntityVersion> versions;
-    size_t maxEntityCount = 0;
+    EntityId firstFree = Entity::INDEX_MASK;
+    size_t freeCount = 0;
 };
 
 struct ComponentMetaData {
-    // assumes 65536 max number of entities
-    using index_type = uint16_t;
-    ComponentSig bitSig = 0;
-    index_type indices[64]{};
+    ComponentSig bitSig;
+};
+
+struct ComponentTypeInfo {
+    size_t size = 0;
+    size_t alignment = 0;
+    bool triviallyRelocatable = false;
+};
+
+struct ComponentMemoryUsage {
+    size_t count = 0;
+    size_t usedBytes = 0;      // taken by live components
+    size_t reservedBytes = 0;  // reserved for the type, including indices
+};
+
+// moves a component into uninitialized memory and ends the source lifetime
+void relocateComponent(byte* source, byte* destination,
+                       ComponentTypeInfo const& info);
+// moves the component at address(sources[i]) to address(i) for every i,
+// following the cycles of the permutation through one temporary slot
+template <typename AddressFn>
+void permuteComponents(std::span<size_t const> sources,
+                       ComponentTypeInfo const& info, AddressFn&& address);
+
+inline constexpr size_t ARCHETYPE_CHUNK_SIZE = 16 * 1024;
+inline constexpr size_t MIN_ARCHETYPE_CHUNK_ROWS = 8;
+
+#ifdef ECS_HUGE_PAGES
+inline constexpr bool USE_HUGE_PAGES = true;
+#else
+inline constexpr bool USE_HUGE_PAGES = false;
+#endif
+
+/*
+Hands out blocks of ARCHETYPE_CHUNK_SIZE times a power of two bytes, carved
+from PAGE_SIZE pages and aligned to ARCHETYPE_CHUNK_SIZE. Freed blocks are kept
+in one free list per size and reused, pages are released with the arena. With
+huge pages the kernel is asked to back the pages with huge pages (Linux only).
+*/
+class ChunkArena final {
+   public:
+    static constexpr size_t PAGE_SIZE = 2 * 1024 * 1024;
+
+    explicit ChunkArena(bool hugePages = USE_HUGE_PAGES) noexcept;
+    ~ChunkArena();
+    ChunkArena(ChunkArena const&) = delete;
+    ChunkArena& operator=(ChunkArena const&) = delete;
+
+    byte* allocate(size_t size);
+    // size has to be the one passed to allocate
+    void deallocate(byte* block, size_t size) noexcept;
+    // bytes taken by a block of the given size
+    static size_t getBlockSize(size_t size) noexcept;
+    size_t getReservedBytes() const noexcept;
+    size_t getUsedBytes() const noexcept;
+
+   private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    static size_t getSizeClass(size_t blockSize) noexcept;
+    void pushFree(byte* block, size_t blockSize) noexcept;
+    byte* allocatePage(size_t size);
+
+    std::vector<FreeBlock*> freeLists;  // indexed by size class
+    std::vector<std::pair<byte*, size_t>> pages;
+    byte* cursor = nullptr;  // unused rest of the last page
+    byte* pageEnd = nullptr;
+    size_t reserved = 0;
+    size_t used = 0;
+    bool hugePages;
+};
+inline constexpr size_t INVALID_ARCHETYPE = std::numeric_limits<size_t>::max();
+
+struct ArchetypeChunk {
+    byte* buffer = nullptr;  // allocated memory
+    byte* data = nullptr;    // aligned beginning of the first column
+    size_t size = 0;
+};
+
+struct EntityLocation {
+    size_t archetype = INVALID_ARCHETYPE;
+    size_t row = 0;
+};
+
+/*
+Stores components of all entities sharing one signature. Memory is split into
+chunks with a power of two number of rows, every chunk holds one contiguous
+column per component type. Rows are dense: only the last chunk can be partially
+filled.
+*/
+class Archetype final {
+   public:
+    Archetype(ComponentSig signature,
+              EcsContainerBuffer<ComponentTypeInfo> const& typeInfo,
+              ChunkArena& arena);
+    ~Archetype();
+    Archetype(Archetype const&) = delete;
+    Archetype& operator=(Archetype const&) = delete;
+
+    ComponentSig getSignature() const noexcept;
+    size_t size() const noexcept;
+    size_t chunkCount() const noexcept;
+    size_t getChunkCapacity() const noexcept;
+    // rows of all allocated chunks, including empty ones
+    size_t getReservedRows() const noexcept;
+    ArchetypeChunk const& getChunk(size_t chunkI) const noexcept;
+    byte* getColumn(size_t chunkI, ComponentId cId) const noexcept;
+    template <typename Component>
+    Component* getColumn(size_t chunkI) const noexcept;
+    byte* getComponent(size_t row, ComponentId cId) const noexcept;
+    EntityId getEntityId(size_t row) const noexcept;
+    // reserves an uninitialized row at the end
+    size_t pushRow();
+    // components of the row must already be moved out or destroyed, the last
+    // row is moved into the hole; returns id of the moved entity
+    EntityId removeRow(size_t row);
+    void destroyRow(size_t row);
+    // row i receives the components of row sources[i]
+    void permuteRows(std::span<size_t const> sources);
+    size_t getEdge(ComponentId cId, bool add) const noexcept;
+    void setEdge(ComponentId cId, bool add, size_t archetype) noexcept;
+
+   private:
+    ComponentSig signature;
+    size_t rows = 0;
+    size_t rowShift = 0;
+    size_t rowMask = 0;
+    size_t chunkBytes = 0;
+    size_t chunkAlignment = 1;
+    ComponentId firstComponent = 0;
+    std::array<size_t, MAX_COMPONENT_TYPES> columnOffsets{};
+    std::array<ComponentTypeInfo, MAX_COMPONENT_TYPES> types{};
+    std::array<size_t, MAX_COMPONENT_TYPES> addEdges;
+    std::array<size_t, MAX_COMPONENT_TYPES> removeEdges;
+    EcsContainerBuffer<ArchetypeChunk> chunks;
+    ChunkArena* arena;
+};
+
+// position of ComponentIterator inside the storage
+struct StorageCursor {
+    size_t archetype = 0;
+    size_t chunk = 0;
 };
 
 class ComponentManager final {
    public:
-    ComponentManager(size_t componentTypesCount);
+    ComponentManager(size_t componentTypesCount, StorageMode mode);
     template <typename Component, typename... Args>
     Component* addComponent(Entity const& entity, Args&&... args);
     template <typename Component>
     Component* getComponent(Entity const& entity, ComponentId cId) const;
     void removeComponent(Entity const& entity, ComponentId cId);
+    void removeAllComponents(Entity const& entity);
+    // entities must not have any components yet; args holds one tuple of
+    // constructor arguments per component type
+    template <typename... Components, typename... ArgTuples>
+    void addComponents(std::span<Entity const> entities,
+                       ArgTuples const&... args);
+    // every component buffer is compacted once
+    void removeAllComponents(std::span<Entity const> entities);
+    // sorts the components of every type (or the rows of every archetype) in
+    // the given order of entity ids, which has to contain every entity owning
+    // a component
+    void reorder(std::span<EntityId const> order);
     bool hasComponent(Entity const& entity, ComponentId cId) const;
     auto getSignature(Entity const& entity) const;
+    // caches touching these components are invalid after a structural change
+    ComponentSig getInvalidationMask(Entity const& entity,
+                                     ComponentId cId) const;
     auto const& getMetaData() const;
+    auto const& getArchetypes() const;
+    ComponentRelocations const& getRelocations() const noexcept;
+    void clearRelocations() noexcept;
+    StorageMode getStorageMode() const noexcept;
+    size_t getComponentCount(ComponentId cId) const;
+    ComponentMemoryUsage getMemoryUsage(ComponentId cId) const;
+    ChunkArena const& getArena() const noexcept;
+    // positions of components of one type in their buffer
+    SparseIndex const& getComponentIndices(ComponentId cId) const;
+    // finds the next non empty range of components starting at the cursor
+    bool nextSegment(ComponentId cId, StorageCursor& cursor, byte*& begin,
+                     byte*& end) const;
     void addEntity(Entity const& entity);
     EcsContainerBuffer<byte>& operator[](size_t i);
     EcsContainerBuffer<byte>& operator[](size_t i) const;
 
    private:
+    template <typename Component>
+    void registerType(ComponentId cId);
+    template <typename Component, typename ArgTuple>
+    void appendComponents(std::span<Entity const> entities,
+                          ArgTuple const& args);
+    size_t findOrCreateArchetype(ComponentSig signature);
+    size_t getNeighbourArchetype(size_t from, ComponentId cId, bool add);
+    // moves shared components, returns the row in the destination archetype
+    size_t moveToArchetype(Entity const& entity, size_t dst);
+
     EcsContainerBuffer<EcsContainerBuffer<byte>> componentData;
     EcsContainerBuffer<ComponentMetaData> metaData;
+    std::vector<SparseIndex> componentIndices;
+    EcsContainerBuffer<ComponentTypeInfo> typeInfo;
+    EcsContainerBuffer<EntityLocation> locations;
+    ChunkArena arena;  // outlives the archetypes using it
+    std::vector<std::unique_ptr<Archetype>> archetypes;
+    std::unordered_map<ComponentSig, size_t> archetypeIndices;
+    ComponentRelocations relocations;
+    StorageMode mode;
+};
+
+// Walks over all components of one type, regardless of how many separate
+// ranges of memory they are stored in
+template <typename T>
+class ComponentIterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = T;
+    using pointer = value_type*;
+    using reference = value_type&;
+
+    ComponentIterator() = default;
+    ComponentIterator(ComponentManager const& manager, ComponentId cId);
+    reference operator*() const noexcept { return *ptr; }
+    pointer operator->() const noexcept { return ptr; }
+    ComponentIterator& operator++() noexcept {
+        if (++ptr == segmentEnd) {
+            nextSegment();
+        }
+        return *this;
+    }
+    ComponentIterator operator++(int) noexcept {
+        auto tmp = *this;
+        ++(*this);
+        return tmp;
+    }
+    bool operator==(ComponentIterator const& o) const noexcept {
+        return ptr == o.ptr;
+    }
+    bool operator!=(ComponentIterator const& o) const noexcept {
+        return ptr != o.ptr;
+    }
+
+   private:
+    void nextSegment() noexcept;
+
+    ComponentManager const* manager = nullptr;
+    ComponentId cId = 0;
+    StorageCursor cursor;
+    T* ptr = nullptr;
+    T* segmentEnd = nullptr;
 };
 
 template <typename Component, typename Tag, typename AllTags>
@@ -209,10 +615,243 @@ class ComponentBase : public MovableBase {
     virtual void moveTo(byte* destination) override;
 };
 
+template <typename Component>
+constexpr ComponentId getComponentId();
+// bit mask with the ids of the given component types set
+template <typename... Components>
+constexpr ComponentSig getComponentSig();
+
+/*
+Query terms besides plain component types, evaluated against entity signatures:
+With<T> requires T without yielding it, Without<T> skips entities having T and
+Optional<T> yields T or nullptr, e.g.
+getEntitiesWithComponents<Transform2D, Optional<Physics2D>, Without<Camera>>()
+*/
+template <typename Component>
+struct With {
+    using component_type = Component;
+};
+
+template <typename Component>
+struct Without {
+    using component_type = Component;
+};
+
+template <typename Component>
+struct Optional {
+    using component_type = Component;
+};
+
+namespace detail {
+template <typename Term>
+struct QueryTerm {
+    using component_type = Term;
+    static constexpr bool required = true;
+    static constexpr bool yielded = true;
+};
+template <typename Component>
+struct QueryTerm<With<Component>> {
+    using component_type = Component;
+    static constexpr bool required = true;
+    static constexpr bool yielded = false;
+};
+template <typename Component>
+struct QueryTerm<Without<Component>> {
+    using component_type = Component;
+    static constexpr bool required = false;
+    static constexpr bool yielded = false;
+};
+template <typename Component>
+struct QueryTerm<Optional<Component>> {
+    using component_type = Component;
+    static constexpr bool required = false;
+    static constexpr bool yielded = true;
+};
+template <typename Term>
+using query_component_t = typename QueryTerm<Term>::component_type;
+template <typename Term>
+inline constexpr bool is_optional_term_v =
+    QueryTerm<Term>::yielded && !QueryTerm<Term>::required;
+}  // namespace detail
+
+template <typename... Terms>
+class QueryView;
+
+namespace detail {
+// QueryView over the yielded terms: plain component types and Optional<T>
+template <typename... Terms>
+struct MakeQueryView {
+    template <typename Term>
+    using yielded_t = std::conditional_t<QueryTerm<Term>::yielded,
+                                         std::tuple<Term>, std::tuple<>>;
+    template <typename... Yielded>
+    static QueryView<Yielded...> make(std::tuple<Yielded...>);
+    using type =
+        decltype(make(std::tuple_cat(std::declval<yielded_t<Terms>>()...)));
+};
+}  // namespace detail
+
+// filters of QueryView::filter, pass tuples whose component of the given type
+// changed or was added after a tick
+template <typename Component>
+struct Changed {
+    using component_type = Component;
+    static bool test(Component const& component, Tick since) noexcept {
+        return component.changedSince(since);
+    }
+};
+
+template <typename Component>
+struct Added {
+    using component_type = Component;
+    static bool test(Component const& component, Tick since) noexcept {
+        return component.addedSince(since);
+    }
+};
+
+template <typename View, typename... Filters>
+class FilteredQueryView;
+
+/*
+Result of a query: a zipped view over the columns of the queried component
+types, yielding tuples of pointers computed from column addresses and indices.
+The view stays valid as storage grows and entities are added or removed,
+structural changes only invalidate its iterators. Components are plain
+component types or Optional<T>, whose pointers may be null.
+*/
+template <typename... Components>
+class QueryView {
+   public:
+    using value_type = std::tuple<detail::query_component_t<Components>*...>;
+
+    // contiguous columns (archetype chunks) or rows of indices into them
+    // (component arrays)
+    struct Segment {
+        value_type columns{};
+        QueryCacheEntry::index_type const* indices = nullptr;
+        size_t size = 0;
+
+        value_type operator[](size_t i) const noexcept;
+        Segment slice(size_t begin, size_t end) const noexcept;
+    };
+
+    class Iterator {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = QueryView::value_type;
+        using reference = value_type;
+
+        Iterator() = default;
+        explicit Iterator(QueryView const& view);
+        reference operator*() const noexcept { return segment[row]; }
+        Iterator& operator++() noexcept {
+            if (++row == segment.size) {
+                row = 0;
+                if (!view->nextSegment(cursor, segment)) {
+                    segment = {};
+                }
+            }
+            return *this;
+        }
+        Iterator operator++(int) noexcept {
+            auto tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+        bool operator==(Iterator const& o) const noexcept {
+            // every exhausted iterator is equal to end()
+            if (segment.size == 0 || o.segment.size == 0) {
+                return segment.size == o.segment.size;
+            }
+            return row == o.row && cursor.archetype == o.cursor.archetype &&
+                   cursor.chunk == o.cursor.chunk;
+        }
+        bool operator!=(Iterator const& o) const noexcept {
+            return !(*this == o);
+        }
+
+       private:
+        QueryView const* view = nullptr;
+        StorageCursor cursor;
+        Segment segment;
+        size_t row = 0;
+    };
+
+    QueryView(EcsContainer& container, QueryCacheEntry& entry);
+    Iterator begin() const;
+    Iterator end() const;
+    size_t size() const;
+    bool empty() const;
+    std::vector<Segment> getSegments() const;
+    // skips tuples not passing every filter, e.g.
+    // query.filter<Changed<Transform2D>>(lastRun)
+    template <typename... Filters>
+    FilteredQueryView<QueryView, Filters...> filter(Tick since) const;
+
+   private:
+    bool nextSegment(StorageCursor& cursor, Segment& segment) const;
+    template <typename Term>
+    static detail::query_component_t<Term>* getColumn(
+        Archetype const& archetype, size_t chunk) noexcept;
+
+    EcsContainer* container;
+    QueryCacheEntry* entry;
+};
+
+template <typename View, typename... Filters>
+class FilteredQueryView {
+   public:
+    using base_iterator = typename View::Iterator;
+
+    class Iterator {
+       public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = typename View::value_type;
+        using reference = value_type;
+
+        Iterator() = default;
+        Iterator(base_iterator it, Tick since);
+        reference operator*() const noexcept { return *it; }
+        Iterator& operator++() noexcept {
+            ++it;
+            skip();
+            return *this;
+        }
+        Iterator operator++(int) noexcept {
+            auto tmp = *this;
+            ++(*this);
+            return tmp;
+        }
+        bool operator==(Iterator const& o) const noexcept {
+            return it == o.it;
+        }
+        bool operator!=(Iterator const& o) const noexcept {
+            return it != o.it;
+        }
+
+       private:
+        void skip() noexcept;
+
+        base_iterator it;
+        Tick since = 0;
+    };
+
+    FilteredQueryView(View view, Tick since);
+    Iterator begin() const;
+    Iterator end() const;
+
+   private:
+    View view;
+    Tick since;
+};
+
 class EcsContainer final {
    public:
     template <typename... ComponentTags>
-    EcsContainer(TypeSequence<ComponentTags...>);
+    EcsContainer(TypeSequence<ComponentTags...>,
+                 StorageMode mode = DEFAULT_STORAGE_MODE);
     ~EcsContainer() = default;
     EcsContainer(EcsContainer&) = delete;
     EcsContainer(EcsContainer&&) = delete;
@@ -220,8 +859,15 @@ class EcsContainer final {
     EcsContainer& operator=(EcsContainer&&) = delete;
 
     Entity const& createEntity();
+    // creates count entities with the same components, each constructed from
+    // a tuple of arguments, e.g. createEntities<A, B>(n, std::tuple(1, 2),
+    // std::tuple())
+    template <typename... Components, typename... ArgTuples>
+    std::vector<Entity> createEntities(size_t count,
+                                       ArgTuples const&... componentArgs);
     bool exists(Entity const& entity) const;
     void removeEntity(Entity const& entity);
+    void removeEntities(std::span<Entity const> entities);
     size_t getCurrentEntityCount()
         const;  // eg. added 10 entities, removed 3 -> return 7
     size_t getMaximumEntityCount()
@@ -229,26 +875,60 @@ class EcsContainer final {
                 // ids of the deleted ones)
     template <typename Component>
     Component* getComponent(Entity const& entity);
+    // Components may contain With<T>, Without<T> and Optional<T> terms
     template <typename... Components>
-    EcsContainerBuffer<std::tuple<Components*...>> const&
+    typename detail::MakeQueryView<Components...>::type
     getEntitiesWithComponents();
     template <typename Component, typename... Args>
     Component* addComponent(Entity const& entity, Args&&... args);
     template <typename Component>
     void removeComponent(Entity const& entity);
+    // sorts component storage so that entities with smaller key(entity) come
+    // first and neighbours in space can become neighbours in memory, e.g. with
+    // a Morton code of the position; ties are kept in entity id order.
+    // Pointers to components are invalidated
+    template <typename KeyFn>
+    void defragment(KeyFn&& key);
+    // undoes the shuffling done by swap-removes, sorts by entity id
+    void defragment();
     template <typename Component>
     auto begin();
     template <typename Component>
     auto end();
+    // contiguous ranges of memory holding all components of one type
+    template <typename Component>
+    std::vector<std::pair<Component*, Component*>> getSegments() const;
+    StorageMode getStorageMode() const noexcept;
+    // indexed by component id
+    std::vector<ComponentMemoryUsage> getMemoryUsage() const;
 
     void printEntityCount() const;
+    void printMemoryUsage() const;
 
    private:
+    friend class CommandBuffer;
+    friend class WorldSnapshot;
+    template <typename... Components>
+    friend class QueryView;
+
     void removeComponentImpl(Entity const& entity, ComponentId cId);
+    // keeps cached queries in sync with a structural change of the entity
+    void onStructuralChange(Entity const& entity, ComponentSig oldSig,
+                            ComponentSig newSig);
+    // changes made between beginBatch and endBatch skip the incremental
+    // cache updates, affected queries are rebuilt once on their next use
+    void beginBatch();
+    void endBatch();
+    // rebuilds a query invalidated by a batch, picks up new archetypes
+    void refreshQuery(QueryCacheEntry& entry);
 
     EntityManager entityManager;
     ComponentManager componentManager;
     ComponentQueryCache entityQueryCache;
+    // queries may be issued from systems running in parallel
+    std::mutex queryMutex;
+    ComponentSig batchChanges;
+    bool batching = false;
     size_t const componentTypesCount;
 };
 
@@ -259,6 +939,18 @@ struct ForEachComponent {
     auto end() { return container.end<Component>(); }
     EcsContainer& container;
 };
+
+/*
+Calls fn for every component (or every tuple of a cached query) on the thread
+pool. Work is split into cache line aligned ranges, fn must not add or remove
+components and has to be safe to run concurrently for different entities.
+*/
+template <typename Component, typename Fn>
+void parallelForEach(ThreadPool& pool, ForEachComponent<Component> components,
+                     Fn&& fn);
+template <typename... Components, typename Fn>
+void parallelForEach(ThreadPool& pool, QueryView<Components...> const& query,
+                     Fn&& fn);
 }  // namespace ecs
 
 #include "EcsContainerInl.hpp"
\ No newline at end of file
@@ -1,61 +1,86 @@
 #pragma once
+#include <bit>
+#include <new>
+#include <numeric>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 namespace ecs {
 /*======================Entity========================================*/
-inline constexpr auto INVALID_ENTITY_ID = std::numeric_limits<EntityId>::max();
-inline constexpr auto INVALID_ENTITY_VERSION =
-    std::numeric_limits<EntityVersion>::max();
+inline constexpr EntityId INVALID_ENTITY_ID = Entity::INDEX_MASK;
+inline constexpr EntityVersion INVALID_ENTITY_VERSION = Entity::VERSION_MASK;
+// generations above it are reserved for invalid and pending entities
+inline constexpr EntityVersion LAST_ENTITY_VERSION = INVALID_ENTITY_VERSION - 2;
 inline constexpr auto INVALID_COMPONENT_SIGNATURE = 0;
 
-inline Entity::Entity()
-    : id(INVALID_ENTITY_ID), version(INVALID_ENTITY_VERSION) {}
+inline Entity::Entity() : Entity(INVALID_ENTITY_ID, INVALID_ENTITY_VERSION) {}
 
 inline Entity::Entity(EntityId id, EntityVersion version)
-    : id(id), version(version) {}
+    : handle(static_cast<EntityHandle>(version << ENTITY_INDEX_BITS) |
+             (id & INDEX_MASK)) {}
 
-inline EntityId Entity::getId() const { return id; }
-inline EntityId Entity::getVersion() const { return version; }
+inline EntityId Entity::getId() const { return handle & INDEX_MASK; }
+inline EntityVersion Entity::getVersion() const {
+    return handle >> ENTITY_INDEX_BITS;
+}
+inline EntityHandle Entity::getHandle() const { return handle; }
 /*======================EntityManager========================================*/
 
 inline Entity const& EntityManager::createEntity() {
-    if (removedIds.empty()) {
-        Entity entity(entities.size(), 0);
-        entities.emplace_back(entity);
-        versions.emplace_back(0);
-        ++maxEntityCount;
+    if (freeCount == 0) {
+        if (entities.size() >= INVALID_ENTITY_ID) {
+            throw std::runtime_error("Entity index bits exhausted");
+        }
+        entities.emplace_back(static_cast<EntityId>(entities.size()), 0);
         return entities.back();
-    } else {
-        auto lastRemoved = removedIds.back();
-        removedIds.pop_back();
-        entities[lastRemoved].version = versions[lastRemoved];
-        return entities[lastRemoved];
     }
+    auto id = firstFree;
+    auto& slot = entities[id];
+    firstFree = slot.getId();
+    --freeCount;
+    slot = Entity(id, slot.getVersion());
+    return slot;
 }
 
 inline void EntityManager::removeEntity(Entity const& entity) {
-    versions[entity.id] += 1;
-    removedIds.emplace_back(entity.id);
+    auto id = entity.getId();
+    auto version = entity.getVersion();
+    auto nextVersion = version < LAST_ENTITY_VERSION ? version + 1 : 0;
+    entities[id] = Entity(firstFree, nextVersion);
+    firstFree = id;
+    ++freeCount;
 }
 
 inline bool EntityManager::exists(Entity const& entity) const {
-    if (entities.size() > entity.id) {
-        if (versions[entity.id] == entity.version) {
-            return true;
-        }
-    }
-    return false;
+    // a free slot never holds its own index
+    auto id = entity.getId();
+    return id < entities.size() && entities[id] == entity;
 }
 
 inline auto const& EntityManager::getEntitites() const { return entities; }
 
 inline size_t EntityManager::getCurrentEntityCount() const {
-    return entities.size() - removedIds.size();
+    return entities.size() - freeCount;
 }
 inline size_t EntityManager::getMaximumEntityCount() const {
-    return maxEntityCount;
+    return entities.size();
 }
 inline Entity const& EntityManager::operator[](size_t index) const {
     return entities[index];
 }
+inline EntityId EntityManager::getFirstFree() const { return firstFree; }
+inline size_t EntityManager::getFreeCount() const { return freeCount; }
+inline void EntityManager::restore(std::span<Entity const> slots,
+                                   EntityId firstFree, size_t freeCount) {
+    entities.clear();
+    entities.reserve(slots.size());
+    for (auto const& slot : slots) {
+        entities.emplace_back(slot);
+    }
+    this->firstFree = firstFree;
+    this->freeCount = freeCount;
+}
 /*======================EcsContainerBuffer========================================*/
 
 template <typename T>
@@ -67,6 +92,26 @@ inline EcsContainerBuffer<T>::~EcsContainerBuffer() noexcept {
     }
 }
 template <typename T>
+inline EcsContainerBuffer<T>::EcsContainerBuffer(EcsContainerBuffer&& o) noexcept
+    : m_capacity(std::exchange(o.m_capacity, 0)),
+      m_size(std::exchange(o.m_size, 0)),
+      m_typeSize(std::exchange(o.m_typeSize, 0)),
+      m_data(std::exchange(o.m_data, nullptr)),
+      m_buffer(std::exchange(o.m_buffer, nullptr)) {}
+
+template <typename T>
+inline EcsContainerBuffer<T>& EcsContainerBuffer<T>::operator=(
+    EcsContainerBuffer&& o) noexcept {
+    if (this != &o) {
+        std::swap(m_capacity, o.m_capacity);
+        std::swap(m_size, o.m_size);
+        std::swap(m_typeSize, o.m_typeSize);
+        std::swap(m_data, o.m_data);
+        std::swap(m_buffer, o.m_buffer);
+    }
+    return *this;
+}
+template <typename T>
 inline size_t EcsContainerBuffer<T>::size() const noexcept {
     return m_size;
 }
@@ -156,6 +201,13 @@ inline void EcsContainerBuffer<T>::resize(size_t newSize) {
     m_size = newSize;
 }
 template <typename T>
+template <typename S>
+inline void EcsContainerBuffer<T>::reserve(size_t newCapacity) {
+    if (newCapacity > m_capacity) {
+        reallocate<S>(newCapacity);
+    }
+}
+template <typename T>
 inline T& EcsContainerBuffer<T>::operator[](size_t i) noexcept {
     return m_data[i];
 }
@@ -204,6 +256,11 @@ inline void EcsContainerBuffer<byte>::pop_back() noexcept {
     --m_size;
 }
 
+template <typename T>
+inline void EcsContainerBuffer<T>::releaseBack() noexcept {
+    --m_size;
+}
+
 template <typename T>
 template <typename S>
 inline void EcsContainerBuffer<T>::reallocate(size_t newCapacity) {
@@ -228,15 +285,20 @@ inline void EcsContainerBuffer<T>::reallocate(size_t newCapacity) {
 
     if constexpr (std::is_same_v<T, byte>) {
         // potentially unaligned byte buffer storing polymorphic type S
-        byte* newBuffer = new byte[m_capacity * m_typeSize + alignof(S)];
-        byte* newData = getAlignedAddress<S>(newBuffer);
+        constexpr size_t alignment = std::max(alignof(S), CACHE_LINE_SIZE);
+        byte* newBuffer = new byte[m_capacity * m_typeSize + alignment];
+        byte* newData = getAlignedAddress(newBuffer, alignment);
         if (m_buffer) {
-            for (size_t i = 0; i < m_size; ++i) {
-                auto* srcBase =
-                    reinterpret_cast<MovableBase*>(m_data + i * m_typeSize);
-                auto* dstBase = newData + i * m_typeSize;
-                srcBase->moveTo(dstBase);
-                srcBase->~MovableBase();
+            if constexpr (IsTriviallyRelocatable<S>::value) {
+                std::memcpy(newData, m_data, m_size * m_typeSize);
+            } else {
+                for (size_t i = 0; i < m_size; ++i) {
+                    auto* srcBase =
+                        reinterpret_cast<MovableBase*>(m_data + i * m_typeSize);
+                    auto* dstBase = newData + i * m_typeSize;
+                    srcBase->moveTo(dstBase);
+                    srcBase->~MovableBase();
+                }
             }
             delete[] m_buffer;
         }
@@ -283,21 +345,59 @@ inline S* EcsContainerBuffer<T>::castBack() const noexcept {
     return reinterpret_cast<S*>(&m_data[m_typeSize * (m_size - 1)]);
 }
 
+/*======================Tick========================================*/
+
+namespace detail {
+// starts above the initial lastRun of systems, so they see everything at first
+inline std::atomic<Tick> currentTick = 1;
+}  // namespace detail
+
+inline Tick getCurrentTick() noexcept {
+    return detail::currentTick.load(std::memory_order_relaxed);
+}
+
+inline Tick advanceTick() noexcept {
+    return detail::currentTick.fetch_add(1, std::memory_order_relaxed);
+}
 /*======================MovableBase========================================*/
 
-inline MovableBase::MovableBase(MovableBase&& o) noexcept : entity(o.entity) {
-    o.entity.id = 0;
+inline MovableBase::MovableBase(MovableBase&& o) noexcept
+    : entity(o.entity), addedTick(o.addedTick), changedTick(o.changedTick) {
+    o.entity = Entity(0, o.entity.getVersion());
 }
 
 inline MovableBase& MovableBase::operator=(MovableBase&& o) noexcept {
     if (this != &o) {
         this->entity = o.entity;
-        o.entity.id = 0;
+        this->addedTick = o.addedTick;
+        this->changedTick = o.changedTick;
+        o.entity = Entity(0, o.entity.getVersion());
     }
     return *this;
 }
 
 inline Entity const& MovableBase::getEntity() const noexcept { return entity; }
+
+inline Tick MovableBase::getAddedTick() const noexcept { return addedTick; }
+
+inline Tick MovableBase::getChangedTick() const noexcept { return changedTick; }
+
+inline bool MovableBase::addedSince(Tick since) const noexcept {
+    return isNewerTick(addedTick, since);
+}
+
+inline bool MovableBase::changedSince(Tick since) const noexcept {
+    return isNewerTick(changedTick, since);
+}
+
+inline void MovableBase::markChanged() noexcept {
+    changedTick = getCurrentTick();
+}
+
+inline void MovableBase::attach(Entity const& owner) noexcept {
+    entity = owner;
+    addedTick = changedTick = getCurrentTick();
+}
 /*======================ComponentBase========================================*/
 
 template <typename Component, typename Tag, typename AllTags>
@@ -321,10 +421,374 @@ inline void ComponentBase<Component, Tag, AllTags>::moveTo(byte* destination) {
     new (destination) Component(std::move(instance));
 }
 
+inline void relocateComponent(byte* source, byte* destination,
+                              ComponentTypeInfo const& info) {
+    if (info.triviallyRelocatable) {
+        std::memcpy(destination, source, info.size);
+    } else {
+        auto* base = reinterpret_cast<MovableBase*>(source);
+        base->moveTo(destination);
+        base->~MovableBase();
+    }
+}
+
+template <typename AddressFn>
+inline void permuteComponents(std::span<size_t const> sources,
+                              ComponentTypeInfo const& info,
+                              AddressFn&& address) {
+    auto alignment = std::max(info.alignment, alignof(std::max_align_t));
+    auto slot = std::make_unique<byte[]>(info.size + alignment);
+    auto* temp = getAlignedAddress(slot.get(), alignment);
+    std::vector<bool> placed(sources.size());
+    for (size_t i = 0; i < sources.size(); ++i) {
+        if (placed[i] || sources[i] == i) {
+            continue;
+        }
+        relocateComponent(address(i), temp, info);
+        size_t j = i;
+        while (sources[j] != i) {
+            relocateComponent(address(sources[j]), address(j), info);
+            placed[j] = true;
+            j = sources[j];
+        }
+        relocateComponent(temp, address(j), info);
+        placed[j] = true;
+    }
+}
+
+template <typename Component>
+constexpr ComponentId getComponentId() {
+    return utils::getTypeIndexFromSequence<typename Component::single_tag>(
+        typename Component::all_tags());
+}
+
+template <typename... Components>
+constexpr ComponentSig getComponentSig() {
+    return (ComponentSig::bit(getComponentId<Components>()) | ... |
+            ComponentSig());
+}
+
+/*======================ChunkArena========================================*/
+
+inline ChunkArena::ChunkArena(bool hugePages) noexcept
+    : hugePages(hugePages) {}
+
+inline ChunkArena::~ChunkArena() {
+    for (auto [page, size] : pages) {
+        ::operator delete(page, std::align_val_t{PAGE_SIZE});
+    }
+}
+
+inline size_t ChunkArena::getBlockSize(size_t size) noexcept {
+    return std::bit_ceil(std::max(size, ARCHETYPE_CHUNK_SIZE));
+}
+
+inline size_t ChunkArena::getSizeClass(size_t blockSize) noexcept {
+    return std::countr_zero(blockSize / ARCHETYPE_CHUNK_SIZE);
+}
+
+inline void ChunkArena::pushFree(byte* block, size_t blockSize) noexcept {
+    auto sizeClass = getSizeClass(blockSize);
+    if (sizeClass >= freeLists.size()) {
+        freeLists.resize(sizeClass + 1, nullptr);
+    }
+    freeLists[sizeClass] = new (block) FreeBlock{freeLists[sizeClass]};
+}
+
+inline byte* ChunkArena::allocatePage(size_t size) {
+    auto* page = static_cast<byte*>(
+        ::operator new(size, std::align_val_t{PAGE_SIZE}));
+    pages.emplace_back(page, size);
+    reserved += size;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (hugePages) {
+        // only a hint, transparent huge pages may be disabled
+        madvise(page, size, MADV_HUGEPAGE);
+    }
+#endif
+    return page;
+}
+
+inline byte* ChunkArena::allocate(size_t size) {
+    auto blockSize = getBlockSize(size);
+    auto sizeClass = getSizeClass(blockSize);
+    used += blockSize;
+    if (sizeClass < freeLists.size() && freeLists[sizeClass]) {
+        auto* block = freeLists[sizeClass];
+        freeLists[sizeClass] = block->next;
+        block->~FreeBlock();
+        return reinterpret_cast<byte*>(block);
+    }
+    if (blockSize >= PAGE_SIZE) {
+        return allocatePage(blockSize);
+    }
+    if (static_cast<size_t>(pageEnd - cursor) < blockSize) {
+        // the rest of the page is split into blocks of power of two sizes
+        while (cursor != pageEnd) {
+            auto rest = std::bit_floor(
+                static_cast<size_t>(pageEnd - cursor) / ARCHETYPE_CHUNK_SIZE) *
+                        ARCHETYPE_CHUNK_SIZE;
+            pushFree(cursor, rest);
+            cursor += rest;
+        }
+        cursor = allocatePage(PAGE_SIZE);
+        pageEnd = cursor + PAGE_SIZE;
+    }
+    auto* block = cursor;
+    cursor += blockSize;
+    return block;
+}
+
+inline void ChunkArena::deallocate(byte* block, size_t size) noexcept {
+    auto blockSize = getBlockSize(size);
+    used -= blockSize;
+    pushFree(block, blockSize);
+}
+
+inline size_t ChunkArena::getReservedBytes() const noexcept {
+    return reserved;
+}
+
+inline size_t ChunkArena::getUsedBytes() const noexcept { return used; }
+
+/*======================Archetype========================================*/
+
+inline Archetype::Archetype(
+    ComponentSig signature,
+    EcsContainerBuffer<ComponentTypeInfo> const& typeInfo, ChunkArena& arena)
+    : signature(signature), arena(&arena) {
+    addEdges.fill(INVALID_ARCHETYPE);
+    removeEdges.fill(INVALID_ARCHETYPE);
+    firstComponent = signature.first();
+    size_t rowSize = 0;
+    size_t maxPadding = 0;
+    for (auto cId : signature) {
+        types[cId] = typeInfo[cId];
+        rowSize += typeInfo[cId].size;
+        maxPadding += std::max(typeInfo[cId].alignment, CACHE_LINE_SIZE);
+        chunkAlignment = std::max(chunkAlignment, typeInfo[cId].alignment);
+    }
+    chunkAlignment = std::max(chunkAlignment, CACHE_LINE_SIZE);
+    if (chunkAlignment > ARCHETYPE_CHUNK_SIZE) {
+        throw std::runtime_error("Component alignment exceeds the chunk size");
+    }
+    // power of two number of rows splits a row index into a chunk index and a
+    // row inside the chunk with a shift and a mask
+    size_t rowCapacity = MIN_ARCHETYPE_CHUNK_ROWS;
+    while (rowCapacity * 2 * rowSize + maxPadding <= ARCHETYPE_CHUNK_SIZE) {
+        rowCapacity *= 2;
+    }
+    rowShift = std::countr_zero(rowCapacity);
+    rowMask = rowCapacity - 1;
+    size_t offset = 0;
+    for (auto cId : signature) {
+        // columns start at cache lines
+        auto alignment = std::max(typeInfo[cId].alignment, CACHE_LINE_SIZE);
+        offset = (offset + alignment - 1) & ~(alignment - 1);
+        columnOffsets[cId] = offset;
+        offset += types[cId].size * rowCapacity;
+    }
+    chunkBytes = offset;
+}
+
+inline Archetype::~Archetype() {
+    for (size_t i = 0; i < rows; ++i) {
+        destroyRow(i);
+    }
+    for (auto& chunk : chunks) {
+        arena->deallocate(chunk.buffer, chunkBytes);
+    }
+}
+
+inline ComponentSig Archetype::getSignature() const noexcept {
+    return signature;
+}
+
+inline size_t Archetype::size() const noexcept { return rows; }
+
+inline size_t Archetype::chunkCount() const noexcept {
+    return (rows + rowMask) >> rowShift;
+}
+
+inline size_t Archetype::getChunkCapacity() const noexcept {
+    return rowMask + 1;
+}
+
+inline size_t Archetype::getReservedRows() const noexcept {
+    return chunks.size() * getChunkCapacity();
+}
+
+inline ArchetypeChunk const& Archetype::getChunk(size_t chunkI) const noexcept {
+    return chunks[chunkI];
+}
+
+inline byte* Archetype::getColumn(size_t chunkI,
+                                  ComponentId cId) const noexcept {
+    return chunks[chunkI].data + columnOffsets[cId];
+}
+
+template <typename Component>
+inline Component* Archetype::getColumn(size_t chunkI) const noexcept {
+    constexpr ComponentId cId =
+        utils::getTypeIndexFromSequence<typename Component::single_tag>(
+            typename Component::all_tags());
+    return reinterpret_cast<Component*>(getColumn(chunkI, cId));
+}
+
+inline byte* Archetype::getComponent(size_t row,
+                                     ComponentId cId) const noexcept {
+    return chunks[row >> rowShift].data + columnOffsets[cId] +
+           (row & rowMask) * types[cId].size;
+}
+
+inline EntityId Archetype::getEntityId(size_t row) const noexcept {
+    auto* base =
+        reinterpret_cast<MovableBase*>(getComponent(row, firstComponent));
+    return base->getEntity().getId();
+}
+
+inline size_t Archetype::pushRow() {
+    size_t chunkI = rows >> rowShift;
+    if (chunkI == chunks.size()) {
+        // arena blocks are aligned to the chunk size
+        ArchetypeChunk chunk;
+        chunk.buffer = arena->allocate(chunkBytes);
+        chunk.data = chunk.buffer;
+        chunks.emplace_back(chunk);
+    }
+    ++chunks[chunkI].size;
+    return rows++;
+}
+
+inline EntityId Archetype::removeRow(size_t row) {
+    size_t last = rows - 1;
+    EntityId moved = INVALID_ENTITY_ID;
+    if (row != last) {
+        for (auto cId : signature) {
+            relocateComponent(getComponent(last, cId), getComponent(row, cId),
+                              types[cId]);
+        }
+        moved = getEntityId(row);
+    }
+    --chunks[last >> rowShift].size;
+    --rows;
+    return moved;
+}
+
+inline void Archetype::destroyRow(size_t row) {
+    for (auto cId : signature) {
+        reinterpret_cast<MovableBase*>(getComponent(row, cId))->~MovableBase();
+    }
+}
+
+inline void Archetype::permuteRows(std::span<size_t const> sources) {
+    for (auto cId : signature) {
+        permuteComponents(sources, types[cId], [&](size_t row) {
+            return getComponent(row, cId);
+        });
+    }
+}
+
+inline size_t Archetype::getEdge(ComponentId cId, bool add) const noexcept {
+    return add ? addEdges[cId] : removeEdges[cId];
+}
+
+inline void Archetype::setEdge(ComponentId cId, bool add,
+                               size_t archetype) noexcept {
+    if (add) {
+        addEdges[cId] = archetype;
+    } else {
+        removeEdges[cId] = archetype;
+    }
+}
+
+/*======================ComponentIterator========================================*/
+
+template <typename T>
+inline ComponentIterator<T>::ComponentIterator(ComponentManager const& manager,
+                                               ComponentId cId)
+    : manager(&manager), cId(cId) {
+    nextSegment();
+}
+
+template <typename T>
+inline void ComponentIterator<T>::nextSegment() noexcept {
+    byte* begin = nullptr;
+    byte* end = nullptr;
+    if (manager->nextSegment(cId, cursor, begin, end)) {
+        ptr = reinterpret_cast<T*>(begin);
+        segmentEnd = reinterpret_cast<T*>(end);
+    } else {
+        ptr = nullptr;
+        segmentEnd = nullptr;
+    }
+}
+
+/*======================SparseIndex========================================*/
+
+inline SparseIndex::index_type SparseIndex::get(EntityId id) const noexcept {
+    auto pageI = id / PAGE_SIZE;
+    if (pageI >= pages.size() || !pages[pageI]) {
+        return INVALID_INDEX;
+    }
+    return pages[pageI]->indices[id % PAGE_SIZE];
+}
+
+inline void SparseIndex::set(EntityId id, index_type index) {
+    auto pageI = id / PAGE_SIZE;
+    if (pageI >= pages.size()) {
+        pages.resize(pageI + 1);
+    }
+    auto& page = pages[pageI];
+    if (!page) {
+        page = std::make_unique<Page>();
+        page->indices.fill(INVALID_INDEX);
+    }
+    auto& slot = page->indices[id % PAGE_SIZE];
+    if (slot == INVALID_INDEX) {
+        ++page->count;
+    }
+    slot = index;
+}
+
+inline void SparseIndex::erase(EntityId id) noexcept {
+    auto pageI = id / PAGE_SIZE;
+    if (pageI >= pages.size() || !pages[pageI]) {
+        return;
+    }
+    auto& page = pages[pageI];
+    auto& slot = page->indices[id % PAGE_SIZE];
+    if (slot != INVALID_INDEX) {
+        slot = INVALID_INDEX;
+        if (--page->count == 0) {
+            page.reset();
+        }
+    }
+}
+
+inline size_t SparseIndex::pageCount() const noexcept {
+    return std::count_if(pages.begin(), pages.end(),
+                         [](auto const& page) { return page != nullptr; });
+}
+
 /*======================ComponentManager========================================*/
 
-inline ComponentManager::ComponentManager(size_t componentTypesCount) {
+inline ComponentManager::ComponentManager(size_t componentTypesCount,
+                                          StorageMode mode)
+    : mode(mode) {
     componentData.resize(componentTypesCount);
+    componentIndices.resize(componentTypesCount);
+    typeInfo.resize(componentTypesCount);
+}
+
+template <typename Component>
+inline void ComponentManager::registerType(ComponentId cId) {
+    if (typeInfo[cId].size == 0) {
+        typeInfo[cId].size = sizeof(Component);
+        typeInfo[cId].alignment = alignof(Component);
+        typeInfo[cId].triviallyRelocatable =
+            IsTriviallyRelocatable<Component>::value;
+    }
 }
 
 template <typename Component, typename... Args>
@@ -339,28 +803,187 @@ inline Component* ComponentManager::addComponent(Entity const& entity,
     constexpr ComponentId cId =
         utils::getTypeIndexFromSequence<SingleTag>(AllTags{});
 
-    auto* component =
-        componentData[cId].emplace_back<Component>(std::forward<Args>(args)...);
-    component->entity = entity;
-    metaData[entity.id].bitSig |= 1ULL << cId;
-    metaData[entity.id].indices[cId] =
-        static_cast<ComponentMetaData::index_type>(componentData[cId].size() -
-                                                   1);
+    registerType<Component>(cId);
+    Component* component = nullptr;
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        auto const& location = locations[entity.getId()];
+        size_t dst = location.archetype == INVALID_ARCHETYPE
+                         ? findOrCreateArchetype(ComponentSig::bit(cId))
+                         : getNeighbourArchetype(location.archetype, cId, true);
+        size_t row = moveToArchetype(entity, dst);
+        component = new (archetypes[dst]->getComponent(row, cId))
+            Component(std::forward<Args>(args)...);
+    } else {
+        if (componentData[cId].size() >= SparseIndex::INVALID_INDEX) {
+            throw std::runtime_error("Too many components of one type");
+        }
+        component = componentData[cId].emplace_back<Component>(
+            std::forward<Args>(args)...);
+        componentIndices[cId].set(entity.getId(),
+                                  static_cast<SparseIndex::index_type>(
+                                      componentData[cId].size() - 1));
+    }
+    component->attach(entity);
+    metaData[entity.getId()].bitSig.set(cId);
     return component;
 }
 
 inline void ComponentManager::removeComponent(Entity const& entity,
                                               ComponentId cId) {
-    if (hasComponent(entity, cId)) {
-        auto delI = metaData[entity.id].indices[cId];
-        auto* del = reinterpret_cast<MovableBase*>(&componentData[cId][delI]);
-        auto* lastOfType = componentData[cId].castBack<MovableBase>();
-        auto lastOfTypeI = lastOfType->entity.id;
-        del->~MovableBase();
-        lastOfType->moveTo(&componentData[cId][delI]);
-        componentData[cId].pop_back();
-        metaData[entity.id].bitSig &= ~(1ULL << cId);
-        metaData[lastOfTypeI].indices[cId] = metaData[entity.id].indices[cId];
+    if (!hasComponent(entity, cId)) {
+        return;
+    }
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        if (metaData[entity.getId()].bitSig == ComponentSig::bit(cId)) {
+            removeAllComponents(entity);
+            return;
+        }
+        auto dst = getNeighbourArchetype(locations[entity.getId()].archetype,
+                                         cId, false);
+        moveToArchetype(entity, dst);
+    } else {
+        auto& buffer = componentData[cId];
+        auto delI = componentIndices[cId].get(entity.getId());
+        auto lastI = buffer.size() - 1;
+        reinterpret_cast<MovableBase*>(&buffer[delI])->~MovableBase();
+        if (delI != lastI) {
+            auto lastOfTypeI = buffer.castBack<MovableBase>()->entity.getId();
+            relocateComponent(&buffer[lastI], &buffer[delI], typeInfo[cId]);
+            componentIndices[cId].set(lastOfTypeI, delI);
+            relocations.moved.emplace_back(
+                Relocation{lastOfTypeI, ComponentSig::bit(cId)});
+        }
+        buffer.releaseBack();
+        componentIndices[cId].erase(entity.getId());
+    }
+    metaData[entity.getId()].bitSig.reset(cId);
+}
+
+inline void ComponentManager::removeAllComponents(Entity const& entity) {
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        auto& location = locations[entity.getId()];
+        if (location.archetype != INVALID_ARCHETYPE) {
+            auto& archetype = *archetypes[location.archetype];
+            archetype.destroyRow(location.row);
+            auto moved = archetype.removeRow(location.row);
+            if (moved != INVALID_ENTITY_ID) {
+                locations[moved].row = location.row;
+                relocations.moved.emplace_back(
+                    Relocation{moved, archetype.getSignature()});
+            }
+            location = {};
+        }
+        metaData[entity.getId()].bitSig = {};
+    } else {
+        for (ComponentId cId = 0; cId < componentData.size(); ++cId) {
+            removeComponent(entity, cId);
+        }
+    }
+}
+
+template <typename... Components, typename... ArgTuples>
+inline void ComponentManager::addComponents(std::span<Entity const> entities,
+                                            ArgTuples const&... args) {
+    static_assert(sizeof...(Components) == sizeof...(ArgTuples),
+                  "One tuple of arguments is needed per component");
+    constexpr ComponentSig signature = getComponentSig<Components...>();
+    (registerType<Components>(getComponentId<Components>()), ...);
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        // all entities end up in the same archetype
+        auto dst = findOrCreateArchetype(signature);
+        auto& archetype = *archetypes[dst];
+        for (auto const& entity : entities) {
+            auto row = archetype.pushRow();
+            locations[entity.getId()] = {dst, row};
+            (std::apply(
+                 [&](auto const&... a) {
+                     auto* component = new (archetype.getComponent(
+                         row, getComponentId<Components>())) Components(a...);
+                     component->attach(entity);
+                 },
+                 args),
+             ...);
+        }
+    } else {
+        (appendComponents<Components>(entities, args), ...);
+    }
+    for (auto const& entity : entities) {
+        metaData[entity.getId()].bitSig = signature;
+    }
+}
+
+template <typename Component, typename ArgTuple>
+inline void ComponentManager::appendComponents(std::span<Entity const> entities,
+                                               ArgTuple const& args) {
+    constexpr ComponentId cId = getComponentId<Component>();
+    auto& buffer = componentData[cId];
+    if (buffer.size() + entities.size() >= SparseIndex::INVALID_INDEX) {
+        throw std::runtime_error("Too many components of one type");
+    }
+    buffer.template reserve<Component>(buffer.size() + entities.size());
+    for (auto const& entity : entities) {
+        auto* component = std::apply(
+            [&](auto const&... a) {
+                return buffer.template emplace_back<Component>(a...);
+            },
+            args);
+        component->attach(entity);
+        componentIndices[cId].set(
+            entity.getId(),
+            static_cast<SparseIndex::index_type>(buffer.size() - 1));
+    }
+}
+
+inline void ComponentManager::removeAllComponents(
+    std::span<Entity const> entities) {
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        for (auto const& entity : entities) {
+            removeAllComponents(entity);
+        }
+        return;
+    }
+    std::vector<SparseIndex::index_type> holes;
+    for (ComponentId cId = 0; cId < componentData.size(); ++cId) {
+        holes.clear();
+        for (auto const& entity : entities) {
+            if (hasComponent(entity, cId)) {
+                holes.push_back(componentIndices[cId].get(entity.getId()));
+                componentIndices[cId].erase(entity.getId());
+            }
+        }
+        if (holes.empty()) {
+            continue;
+        }
+        auto& buffer = componentData[cId];
+        for (auto hole : holes) {
+            reinterpret_cast<MovableBase*>(&buffer[hole])->~MovableBase();
+        }
+        // fill the holes with live components from the end of the buffer
+        std::sort(holes.begin(), holes.end());
+        size_t end = buffer.size();
+        size_t front = 0;
+        size_t back = holes.size();
+        while (front < back) {
+            if (holes[back - 1] == end - 1) {
+                --back;
+                --end;
+                continue;
+            }
+            auto hole = holes[front++];
+            auto movedId = reinterpret_cast<MovableBase*>(&buffer[end - 1])
+                               ->entity.getId();
+            relocateComponent(&buffer[end - 1], &buffer[hole], typeInfo[cId]);
+            componentIndices[cId].set(movedId, hole);
+            relocations.moved.emplace_back(
+                Relocation{movedId, ComponentSig::bit(cId)});
+            --end;
+        }
+        while (buffer.size() > end) {
+            buffer.releaseBack();
+        }
+    }
+    for (auto const& entity : entities) {
+        metaData[entity.getId()].bitSig = {};
     }
 }
 
@@ -368,13 +991,77 @@ template <typename Component>
 inline Component* ComponentManager::getComponent(Entity const& entity,
                                                  ComponentId cId) const {
     if (hasComponent(entity, cId)) {
-        auto componentIndex = metaData[entity.id].indices[cId];
+        if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+            auto const& location = locations[entity.getId()];
+            return reinterpret_cast<Component*>(
+                archetypes[location.archetype]->getComponent(location.row,
+                                                             cId));
+        }
+        auto componentIndex = componentIndices[cId].get(entity.getId());
         auto found = componentData[cId].castBegin<Component>() + componentIndex;
         return &*found;
     }
     return nullptr;
 }
 
+inline size_t ComponentManager::findOrCreateArchetype(ComponentSig signature) {
+    auto found = archetypeIndices.find(signature);
+    if (found != archetypeIndices.end()) {
+        return found->second;
+    }
+    archetypes.emplace_back(
+        std::make_unique<Archetype>(signature, typeInfo, arena));
+    archetypeIndices.emplace(signature, archetypes.size() - 1);
+    return archetypes.size() - 1;
+}
+
+inline size_t ComponentManager::getNeighbourArchetype(size_t from,
+                                                      ComponentId cId,
+                                                      bool add) {
+    auto edge = archetypes[from]->getEdge(cId, add);
+    if (edge == INVALID_ARCHETYPE) {
+        auto signature = archetypes[from]->getSignature();
+        if (add) {
+            signature.set(cId);
+        } else {
+            signature.reset(cId);
+        }
+        edge = findOrCreateArchetype(signature);
+        archetypes[from]->setEdge(cId, add, edge);
+    }
+    return edge;
+}
+
+inline size_t ComponentManager::moveToArchetype(Entity const& entity,
+                                                size_t dst) {
+    auto& location = locations[entity.getId()];
+    auto& dstArchetype = *archetypes[dst];
+    auto dstSignature = dstArchetype.getSignature();
+    size_t dstRow = dstArchetype.pushRow();
+    if (location.archetype != INVALID_ARCHETYPE) {
+        auto& srcArchetype = *archetypes[location.archetype];
+        for (auto cId : srcArchetype.getSignature()) {
+            auto* src = srcArchetype.getComponent(location.row, cId);
+            if (dstSignature.test(cId)) {
+                relocateComponent(src, dstArchetype.getComponent(dstRow, cId),
+                                  typeInfo[cId]);
+            } else {
+                reinterpret_cast<MovableBase*>(src)->~MovableBase();
+            }
+        }
+        auto moved = srcArchetype.removeRow(location.row);
+        if (moved != INVALID_ENTITY_ID) {
+            locations[moved].row = location.row;
+            relocations.moved.emplace_back(
+                Relocation{moved, srcArchetype.getSignature()});
+        }
+    }
+    location.archetype = dst;
+    location.row = dstRow;
+    relocations.moved.emplace_back(Relocation{entity.getId(), dstSignature});
+    return dstRow;
+}
+
 inline EcsContainerBuffer<byte>& ComponentManager::operator[](size_t i) {
     return componentData[i];
 }
@@ -385,27 +1072,175 @@ inline EcsContainerBuffer<byte>& ComponentManager::operator[](size_t i) const {
 
 inline bool ComponentManager::hasComponent(Entity const& entity,
                                            ComponentId cId) const {
-    return metaData[entity.id].bitSig & (1ULL << cId);
+    return metaData[entity.getId()].bitSig.test(cId);
 }
 
 inline auto ComponentManager::getSignature(Entity const& entity) const {
-    return metaData[entity.id].bitSig;
+    return metaData[entity.getId()].bitSig;
+}
+
+inline ComponentSig ComponentManager::getInvalidationMask(
+    Entity const& entity, ComponentId cId) const {
+    // moving an entity between archetypes moves all of its components
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        return ComponentSig(metaData[entity.getId()].bitSig).set(cId);
+    }
+    return ComponentSig::bit(cId);
+}
+
+inline void ComponentManager::reorder(std::span<EntityId const> order) {
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        std::vector<std::vector<size_t>> sources(archetypes.size());
+        for (auto id : order) {
+            auto const& location = locations[id];
+            if (location.archetype != INVALID_ARCHETYPE) {
+                sources[location.archetype].push_back(location.row);
+            }
+        }
+        for (size_t a = 0; a < archetypes.size(); ++a) {
+            auto& archetype = *archetypes[a];
+            archetype.permuteRows(sources[a]);
+            for (size_t row = 0; row < archetype.size(); ++row) {
+                locations[archetype.getEntityId(row)].row = row;
+            }
+        }
+        return;
+    }
+    std::vector<size_t> sources;
+    for (ComponentId cId = 0; cId < componentData.size(); ++cId) {
+        auto& buffer = componentData[cId];
+        if (buffer.size() < 2) {
+            continue;
+        }
+        sources.clear();
+        for (auto id : order) {
+            auto index = componentIndices[cId].get(id);
+            if (index != SparseIndex::INVALID_INDEX) {
+                sources.push_back(index);
+            }
+        }
+        permuteComponents(sources, typeInfo[cId],
+                          [&](size_t i) { return &buffer[i]; });
+        for (size_t i = 0; i < buffer.size(); ++i) {
+            auto* base = reinterpret_cast<MovableBase*>(&buffer[i]);
+            componentIndices[cId].set(base->entity.getId(),
+                                      static_cast<SparseIndex::index_type>(i));
+        }
+    }
 }
 
 inline auto const& ComponentManager::getMetaData() const { return metaData; }
 
+inline auto const& ComponentManager::getArchetypes() const {
+    return archetypes;
+}
+
+inline ComponentRelocations const& ComponentManager::getRelocations()
+    const noexcept {
+    return relocations;
+}
+
+inline void ComponentManager::clearRelocations() noexcept {
+    relocations.moved.clear();
+}
+
+inline SparseIndex const& ComponentManager::getComponentIndices(
+    ComponentId cId) const {
+    return componentIndices[cId];
+}
+
+inline StorageMode ComponentManager::getStorageMode() const noexcept {
+    return mode;
+}
+
+inline size_t ComponentManager::getComponentCount(ComponentId cId) const {
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        size_t count = 0;
+        for (auto const& archetype : archetypes) {
+            if (archetype->getSignature().test(cId)) {
+                count += archetype->size();
+            }
+        }
+        return count;
+    }
+    return componentData[cId].size();
+}
+
+inline ComponentMemoryUsage ComponentManager::getMemoryUsage(
+    ComponentId cId) const {
+    ComponentMemoryUsage usage;
+    auto size = typeInfo[cId].size;
+    if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+        for (auto const& archetype : archetypes) {
+            if (archetype->getSignature().test(cId)) {
+                usage.count += archetype->size();
+                usage.reservedBytes += archetype->getReservedRows() * size;
+            }
+        }
+    } else {
+        usage.count = componentData[cId].size();
+        usage.reservedBytes =
+            componentData[cId].capacity() * size +
+            componentIndices[cId].pageCount() * SparseIndex::PAGE_SIZE *
+                sizeof(SparseIndex::index_type);
+    }
+    usage.usedBytes = usage.count * size;
+    return usage;
+}
+
+inline ChunkArena const& ComponentManager::getArena() const noexcept {
+    return arena;
+}
+
+inline bool ComponentManager::nextSegment(ComponentId cId,
+                                          StorageCursor& cursor, byte*& begin,
+                                          byte*& end) const {
+    if (mode == StorageMode::COMPONENT_ARRAYS) {
+        auto const& buffer = componentData[cId];
+        if (cursor.archetype == 0 && !buffer.empty()) {
+            begin = buffer.data();
+            end = begin + buffer.size() * buffer.typeSize();
+            cursor.archetype = 1;
+            return true;
+        }
+        return false;
+    }
+    for (; cursor.archetype < archetypes.size();
+         ++cursor.archetype, cursor.chunk = 0) {
+        auto const& archetype = *archetypes[cursor.archetype];
+        if (!archetype.getSignature().test(cId)) {
+            continue;
+        }
+        if (cursor.chunk < archetype.chunkCount()) {
+            begin = archetype.getColumn(cursor.chunk, cId);
+            end = begin + archetype.getChunk(cursor.chunk).size *
+                              typeInfo[cId].size;
+            ++cursor.chunk;
+            return true;
+        }
+    }
+    return false;
+}
+
 inline void ComponentManager::addEntity(Entity const& entity) {
-    if (entity.id >= metaData.size()) {
-        metaData.resize(entity.id + 1);
+    if (entity.getId() >= metaData.size()) {
+        metaData.resize(entity.getId() + 1);
+        if (mode == StorageMode::ARCHETYPE_CHUNKS) {
+            locations.resize(entity.getId() + 1);
+        }
     }
 }
 
 /*======================EcsContainer========================================*/
 
 template <typename... ComponentTags>
-inline EcsContainer::EcsContainer(TypeSequence<ComponentTags...>)
+inline EcsContainer::EcsContainer(TypeSequence<ComponentTags...>,
+                                  StorageMode mode)
     : componentTypesCount(sizeof...(ComponentTags)),
-      componentManager(sizeof...(ComponentTags)) {}
+      componentManager(sizeof...(ComponentTags), mode) {
+    static_assert(sizeof...(ComponentTags) <= MAX_COMPONENT_TYPES,
+                  "Too many component types");
+}
 
 inline Entity const& EcsContainer::createEntity() {
     auto const& entity = entityManager.createEntity();
@@ -413,6 +1248,25 @@ inline Entity const& EcsContainer::createEntity() {
     return entity;
 }
 
+template <typename... Components, typename... ArgTuples>
+inline std::vector<Entity> EcsContainer::createEntities(
+    size_t count, ArgTuples const&... componentArgs) {
+    std::vector<Entity> entities;
+    entities.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        entities.emplace_back(createEntity());
+    }
+    componentManager.addComponents<Components...>(entities, componentArgs...);
+    componentManager.clearRelocations();
+    // one invalidation instead of an update per entity
+    if (batching) {
+        batchChanges |= getComponentSig<Components...>();
+    } else {
+        entityQueryCache.purge(getComponentSig<Components...>());
+    }
+    return entities;
+}
+
 template <typename Component, typename... Args>
 inline Component* EcsContainer::addComponent(Entity const& entity,
                                              Args&&... args) {
@@ -427,9 +1281,12 @@ inline Component* EcsContainer::addComponent(Entity const& entity,
 
     if (entityManager.exists(entity) &&
         !componentManager.hasComponent(entity, cId)) {
-        entityQueryCache.purge(cId);
-        return componentManager.addComponent<Component>(
+        auto oldSig = componentManager.getSignature(entity);
+        auto* component = componentManager.addComponent<Component>(
             entity, std::forward<Args>(args)...);
+        onStructuralChange(entity, oldSig,
+                           componentManager.getSignature(entity));
+        return component;
     }
     return nullptr;
 }
@@ -452,8 +1309,10 @@ inline void EcsContainer::removeComponentImpl(Entity const& entity,
                                               ComponentId cId) {
     if (entityManager.exists(entity) &&
         componentManager.hasComponent(entity, cId)) {
+        auto oldSig = componentManager.getSignature(entity);
         componentManager.removeComponent(entity, cId);
-        entityQueryCache.purge(cId);
+        onStructuralChange(entity, oldSig,
+                           componentManager.getSignature(entity));
     }
 }
 
@@ -466,11 +1325,22 @@ inline auto EcsContainer::begin() {
     constexpr ComponentId cId =
         utils::getTypeIndexFromSequence<SingleTag>(AllTags{});
 
-    return componentManager[cId].castBegin<Component>();
+    return ComponentIterator<Component>(componentManager, cId);
 }
 
 template <typename Component>
 inline auto EcsContainer::end() {
+    using SingleTag = typename Component::single_tag;
+    using AllTags = typename Component::all_tags;
+    static_assert(utils::containsTypeInSequence<SingleTag>(AllTags{}),
+                  "Component tag was not defined");
+
+    return ComponentIterator<Component>();
+}
+
+template <typename Component>
+inline std::vector<std::pair<Component*, Component*>> EcsContainer::getSegments()
+    const {
     using SingleTag = typename Component::single_tag;
     using AllTags = typename Component::all_tags;
     static_assert(utils::containsTypeInSequence<SingleTag>(AllTags{}),
@@ -478,74 +1348,176 @@ inline auto EcsContainer::end() {
     constexpr ComponentId cId =
         utils::getTypeIndexFromSequence<SingleTag>(AllTags{});
 
-    return componentManager[cId].castEnd<Component>();
+    std::vector<std::pair<Component*, Component*>> segments;
+    StorageCursor cursor;
+    byte* begin = nullptr;
+    byte* end = nullptr;
+    while (componentManager.nextSegment(cId, cursor, begin, end)) {
+        segments.emplace_back(reinterpret_cast<Component*>(begin),
+                              reinterpret_cast<Component*>(end));
+    }
+    return segments;
+}
+
+inline StorageMode EcsContainer::getStorageMode() const noexcept {
+    return componentManager.getStorageMode();
 }
 
 template <typename... Components>
-inline EcsContainerBuffer<std::tuple<Components*...>> const&
+inline typename detail::MakeQueryView<Components...>::type
 EcsContainer::getEntitiesWithComponents() {
-    using result_t = EcsContainerBuffer<std::tuple<Components*...>>;
+    using View = typename detail::MakeQueryView<Components...>::type;
     static_assert(
-        (utils::containsTypeInSequence<typename Components::single_tag>(
-             typename Components::all_tags()) &&
+        (utils::containsTypeInSequence<
+             typename detail::query_component_t<Components>::single_tag>(
+             typename detail::query_component_t<Components>::all_tags()) &&
          ...),
         "Component was not defined during initialization");
+    static_assert((detail::QueryTerm<Components>::required || ...),
+                  "Query needs at least one required component");
 
     constexpr auto sig = [] {
-        ComponentSig bitSig = 0;
-        std::array<byte, 64> byteSig{};
+        QuerySignature sig;
         size_t i = 0;
-        ((bitSig |=
-          (1LL
-           << utils::getTypeIndexFromSequence<typename Components::single_tag>(
-                  typename Components::all_tags()))),
-         ...);
-        ((byteSig
-              [utils::getTypeIndexFromSequence<typename Components::single_tag>(
-                  typename Components::all_tags())] = ++i),
-         ...);
-        return std::pair(bitSig, byteSig);
+        auto addTerm = [&]<typename Term>() {
+            using Info = detail::QueryTerm<Term>;
+            constexpr auto cId =
+                getComponentId<detail::query_component_t<Term>>();
+            if constexpr (Info::yielded) {
+                sig.columns[cId] = static_cast<byte>(++i);
+            }
+            if constexpr (Info::required) {
+                sig.required.set(cId);
+            } else if constexpr (Info::yielded) {
+                sig.optional.set(cId);
+            } else {
+                sig.excluded.set(cId);
+            }
+        };
+        (addTerm.template operator()<Components>(), ...);
+        return sig;
     }();
 
-    auto cacheResult = entityQueryCache.find(sig);
-    size_t cacheIndex = 0;
-    bool reuseIndex = false;
-    if (cacheResult.second) {
-        if (cacheResult.second->dirty) {
-            static_cast<result_t*>(cacheResult.second->buffer)->clear();
-            cacheResult.second->dirty = false;
-            reuseIndex = true;
-            cacheIndex = cacheResult.first;
-        } else {
-            auto* genericBuffer =
-                static_cast<result_t*>(cacheResult.second->buffer);
-            return *genericBuffer;
+    auto id = getQueryId<Components...>();
+    std::lock_guard lock(queryMutex);
+    auto* entry = entityQueryCache.find(id);
+    if (!entry) {
+        entry = &entityQueryCache.createCache(id, sig);
+    }
+    return View(*this, *entry);
+}
+
+inline void EcsContainer::refreshQuery(QueryCacheEntry& entry) {
+    std::lock_guard lock(queryMutex);
+    if (componentManager.getStorageMode() == StorageMode::ARCHETYPE_CHUNKS) {
+        // archetypes are never removed, only new ones have to be checked
+        auto const& archetypes = componentManager.getArchetypes();
+        for (; entry.scannedArchetypes < archetypes.size();
+             ++entry.scannedArchetypes) {
+            auto signature = archetypes[entry.scannedArchetypes]->getSignature();
+            if (entry.matches(signature)) {
+                entry.archetypes.push_back(entry.scannedArchetypes);
+            }
         }
+        entry.dirty = false;
+        return;
     }
-    if (!reuseIndex) {
-        cacheIndex = entityQueryCache.createCache<Components*...>(sig);
+    if (!entry.dirty) {
+        return;
     }
+    entityQueryCache.clear(entry);
     auto const& metaData = componentManager.getMetaData();
     auto const& entities = entityManager.getEntitites();
     for (size_t i = 0; i < metaData.size(); ++i) {
-        if ((metaData[i].bitSig & sig.first) == sig.first) {
-            entityQueryCache.addTuple(
-                cacheIndex,
-                std::tuple(getComponent<Components>(entities[i])...));
+        if (entry.matches(metaData[i].bitSig)) {
+            entityQueryCache.insert(entry, componentManager, entities[i]);
         }
     }
-    return *static_cast<result_t*>(entityQueryCache[cacheIndex].buffer);
+    entry.dirty = false;
 }
 
 inline void EcsContainer::removeEntity(Entity const& entity) {
     if (entityManager.exists(entity)) {
-        for (ComponentId cId = 0; cId < componentTypesCount; ++cId) {
-            removeComponentImpl(entity, cId);
-        }
+        auto oldSig = componentManager.getSignature(entity);
+        componentManager.removeAllComponents(entity);
+        onStructuralChange(entity, oldSig, {});
         entityManager.removeEntity(entity);
     }
 }
 
+inline void EcsContainer::removeEntities(std::span<Entity const> entities) {
+    std::vector<Entity> removed;
+    removed.reserve(entities.size());
+    ComponentSig changed;
+    for (auto const& entity : entities) {
+        // removing bumps the version, duplicates are skipped
+        if (entityManager.exists(entity)) {
+            changed |= componentManager.getSignature(entity);
+            entityManager.removeEntity(entity);
+            removed.emplace_back(entity);
+        }
+    }
+    componentManager.removeAllComponents(removed);
+    componentManager.clearRelocations();
+    if (batching) {
+        batchChanges |= changed;
+    } else {
+        entityQueryCache.purge(changed);
+    }
+}
+
+template <typename KeyFn>
+inline void EcsContainer::defragment(KeyFn&& key) {
+    auto const& metaData = componentManager.getMetaData();
+    std::vector<std::pair<uint64_t, EntityId>> keys;
+    keys.reserve(metaData.size());
+    for (EntityId id = 0; id < metaData.size(); ++id) {
+        if (metaData[id].bitSig.any()) {
+            keys.emplace_back(static_cast<uint64_t>(key(entityManager[id])),
+                              id);
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<EntityId> order;
+    order.reserve(keys.size());
+    for (auto const& [k, id] : keys) {
+        order.push_back(id);
+    }
+    componentManager.reorder(order);
+    // rows of indices point to old positions, archetype lists stay valid
+    entityQueryCache.purge(ComponentSig::all());
+}
+
+inline void EcsContainer::defragment() {
+    defragment([](Entity const& entity) { return entity.getId(); });
+}
+
+inline void EcsContainer::onStructuralChange(Entity const& entity,
+                                             ComponentSig oldSig,
+                                             ComponentSig newSig) {
+    if (componentManager.getStorageMode() == StorageMode::ARCHETYPE_CHUNKS) {
+        // archetype queries read the chunks directly, nothing to update
+    } else if (batching) {
+        // relocated components always belong to one of these types
+        batchChanges |= oldSig | newSig;
+    } else {
+        entityQueryCache.update(componentManager, entity, oldSig, newSig,
+                                componentManager.getRelocations());
+    }
+    componentManager.clearRelocations();
+}
+
+inline void EcsContainer::beginBatch() {
+    batching = true;
+    batchChanges = {};
+}
+
+inline void EcsContainer::endBatch() {
+    batching = false;
+    entityQueryCache.purge(batchChanges);
+    batchChanges = {};
+}
+
 template <typename Component>
 inline Component* EcsContainer::getComponent(Entity const& entity) {
     using SingleTag = typename Component::single_tag;
@@ -560,10 +1532,32 @@ inline Component* EcsContainer::getComponent(Entity const& entity) {
     return componentManager.getComponent<Component>(entity, cId);
 }
 
+inline std::vector<ComponentMemoryUsage> EcsContainer::getMemoryUsage()
+    const {
+    std::vector<ComponentMemoryUsage> usage;
+    for (ComponentId cId = 0; cId < componentTypesCount; ++cId) {
+        usage.push_back(componentManager.getMemoryUsage(cId));
+    }
+    return usage;
+}
+
+inline void EcsContainer::printMemoryUsage() const {
+    auto usage = getMemoryUsage();
+    for (ComponentId cId = 0; cId < usage.size(); ++cId) {
+        std::cout << "cID " << cId << ", components: " << usage[cId].count
+                  << ", used bytes: " << usage[cId].usedBytes
+                  << ", reserved bytes: " << usage[cId].reservedBytes << '\n';
+    }
+    auto const& arena = componentManager.getArena();
+    std::cout << "chunk arena, used bytes: " << arena.getUsedBytes()
+              << ", reserved bytes: " << arena.getReservedBytes() << '\n';
+}
+
 inline void EcsContainer::printEntityCount() const {
     for (int i = 0; i < componentTypesCount; ++i) {
         std::cout << "cID " << i
-                  << ", component count: " << componentManager[i].size()
+                  << ", component count: "
+                  << componentManager.getComponentCount(i)
                   << '\n';
     }
 }
@@ -580,52 +1574,415 @@ inline bool EcsContainer::exists(Entity const& entity) const {
 
 /*======================ComponentQueryCache========================================*/
 
-template <typename TupleType>
-inline void ComponentQueryCache::addTuple(size_t index,
-                                          TupleType const& cTuple) {
-    auto* genericBuffer =
-        static_cast<EcsContainerBuffer<TupleType>*>(cache[index].buffer);
-    genericBuffer->emplace_back(cTuple);
-}
-// returns index to the new cache
-template <typename... PointersToComponents>
-inline size_t ComponentQueryCache::createCache(sig_t const& sig) {
-    QueryCacheEntry entry;
-    entry.bitSig = sig.first;
-    std::copy(sig.second.begin(), sig.second.end(), entry.byteSig.begin());
-    entry.buffer =
-        new EcsContainerBuffer<std::tuple<PointersToComponents...>>();
-    cache.emplace_back(entry);
-    return cache.size() - 1;
-}
-
-inline ComponentQueryCache::~ComponentQueryCache() {
+inline bool QueryCacheEntry::matches(
+    ComponentSig const& signature) const noexcept {
+    return signature.contains(bitSig) && !signature.intersects(excludedSig);
+}
+
+namespace detail {
+inline std::atomic<QueryId> nextQueryId = 0;
+}  // namespace detail
+
+template <typename... Components>
+inline QueryId getQueryId() noexcept {
+    static QueryId const id =
+        detail::nextQueryId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+
+inline QueryCacheEntry& ComponentQueryCache::createCache(QueryId id,
+                                                         sig_t const& sig) {
+    auto entry = std::make_unique<QueryCacheEntry>();
+    entry->bitSig = sig.required;
+    entry->excludedSig = sig.excluded;
+    entry->optionalSig = sig.optional;
+    for (ComponentId cId = 0; cId < sig.columns.size(); ++cId) {
+        if (auto position = sig.columns[cId]) {
+            entry->columns[position - 1] = cId;
+            ++entry->columnCount;
+        }
+    }
+    if (id >= slots.size()) {
+        slots.resize(id + 1, nullptr);
+    }
+    slots[id] = entry.get();
+    cache.emplace_back(std::move(entry));
+    return *cache.back();
+}
+
+inline bool ComponentQueryCache::contains(QueryCacheEntry const& entry,
+                                          EntityId id) {
+    return id < entry.positions.size() &&
+           entry.positions[id] != QueryCacheEntry::NOT_CACHED;
+}
+
+inline void ComponentQueryCache::writeRow(QueryCacheEntry& entry,
+                                          ComponentManager const& manager,
+                                          size_t index, EntityId id) {
+    if (index * entry.columnCount == entry.rows.size()) {
+        for (size_t c = 0; c < entry.columnCount; ++c) {
+            entry.rows.emplace_back(
+                manager.getComponentIndices(entry.columns[c]).get(id));
+        }
+        return;
+    }
+    auto* row = &entry.rows[index * entry.columnCount];
+    for (size_t c = 0; c < entry.columnCount; ++c) {
+        row[c] = manager.getComponentIndices(entry.columns[c]).get(id);
+    }
+}
+
+inline void ComponentQueryCache::insert(QueryCacheEntry& entry,
+                                        ComponentManager const& manager,
+                                        Entity const& entity) {
+    auto index = entry.entities.size();
+    writeRow(entry, manager, index, entity.getId());
+    if (entity.getId() >= entry.positions.size()) {
+        entry.positions.resize(entity.getId() + 1);
+    }
+    entry.positions[entity.getId()] = index + 1;
+    entry.entities.emplace_back(entity);
+}
+
+inline void ComponentQueryCache::erase(QueryCacheEntry& entry, EntityId id) {
+    auto index = entry.positions[id] - 1;
+    auto last = entry.entities.size() - 1;
+    if (index != last) {
+        std::copy_n(&entry.rows[last * entry.columnCount], entry.columnCount,
+                    &entry.rows[index * entry.columnCount]);
+        auto moved = entry.entities[last];
+        entry.entities[index] = moved;
+        entry.positions[moved.getId()] = index + 1;
+    }
+    entry.rows.resize(last * entry.columnCount);
+    entry.entities.pop_back();
+    entry.positions[id] = QueryCacheEntry::NOT_CACHED;
+}
+
+inline void ComponentQueryCache::clear(QueryCacheEntry& entry) {
+    for (auto const& entity : entry.entities) {
+        entry.positions[entity.getId()] = QueryCacheEntry::NOT_CACHED;
+    }
+    entry.entities.clear();
+    entry.rows.clear();
+}
+
+inline void ComponentQueryCache::refresh(QueryCacheEntry& entry,
+                                         ComponentManager const& manager,
+                                         EntityId id) {
+    if (contains(entry, id)) {
+        writeRow(entry, manager, entry.positions[id] - 1, id);
+    }
+}
+
+inline void ComponentQueryCache::update(
+    ComponentManager const& manager, Entity const& entity, ComponentSig oldSig,
+    ComponentSig newSig, ComponentRelocations const& relocations) {
+    for (auto& entry : cache) {
+        if (entry->dirty) {
+            continue;  // rebuilt from scratch before the next use
+        }
+        bool matched = entry->matches(oldSig);
+        bool matches = entry->matches(newSig);
+        if (matched && !matches) {
+            erase(*entry, entity.getId());
+        } else if (!matched && matches) {
+            insert(*entry, manager, entity);
+        } else if (matches && entry->optionalSig.intersects(oldSig ^ newSig)) {
+            refresh(*entry, manager, entity.getId());
+        }
+        auto yielded = entry->bitSig | entry->optionalSig;
+        for (auto const& relocation : relocations.moved) {
+            if (yielded.intersects(relocation.components)) {
+                refresh(*entry, manager, relocation.entity);
+            }
+        }
+    }
+}
+
+inline QueryCacheEntry* ComponentQueryCache::find(QueryId id) const noexcept {
+    return id < slots.size() ? slots[id] : nullptr;
+}
+
+inline void ComponentQueryCache::purge(ComponentSig const& changed) {
     for (auto& entry : cache) {
-        delete static_cast<EcsContainerBufferBase*>(entry.buffer);
+        if ((entry->bitSig | entry->excludedSig | entry->optionalSig)
+                .intersects(changed)) {
+            entry->dirty = true;
+        }
     }
 }
+/*======================QueryView========================================*/
 
-inline std::pair<size_t, QueryCacheEntry*> ComponentQueryCache::find(
-    sig_t const& sig) {
-    for (size_t i = 0; i < cache.size(); ++i) {
-        if (sig.first == cache[i].bitSig) {
-            if (sig.second == cache[i].byteSig) {
-                return std::pair(i, &cache[i]);
+namespace detail {
+// pointer to the component at offset of a column, columns of optional terms
+// are null in archetypes without the type
+template <typename Term, typename Component>
+inline Component* offsetColumn(Component* column, size_t offset) noexcept {
+    if constexpr (is_optional_term_v<Term>) {
+        return column ? column + offset : nullptr;
+    } else {
+        return column + offset;
+    }
+}
+
+template <typename Term, typename Component>
+inline Component* indexColumn(Component* column,
+                              QueryCacheEntry::index_type index) noexcept {
+    if constexpr (is_optional_term_v<Term>) {
+        return index != SparseIndex::INVALID_INDEX ? column + index : nullptr;
+    } else {
+        return column + index;
+    }
+}
+}  // namespace detail
+
+template <typename... Components>
+inline auto QueryView<Components...>::Segment::operator[](size_t i) const noexcept
+    -> value_type {
+    return [&]<size_t... C>(std::index_sequence<C...>) {
+        if (indices) {
+            auto const* row = indices + i * sizeof...(Components);
+            return value_type(detail::indexColumn<Components>(
+                std::get<C>(columns), row[C])...);
+        }
+        return value_type(
+            detail::offsetColumn<Components>(std::get<C>(columns), i)...);
+    }(std::index_sequence_for<Components...>{});
+}
+
+template <typename... Components>
+inline auto QueryView<Components...>::Segment::slice(size_t begin,
+                                                     size_t end) const noexcept
+    -> Segment {
+    Segment segment = *this;
+    segment.size = end - begin;
+    if (indices) {
+        segment.indices += begin * sizeof...(Components);
+    } else {
+        segment.columns = std::apply(
+            [begin](auto*... column) {
+                return value_type(
+                    detail::offsetColumn<Components>(column, begin)...);
+            },
+            columns);
+    }
+    return segment;
+}
+
+template <typename... Components>
+inline QueryView<Components...>::Iterator::Iterator(QueryView const& view)
+    : view(&view) {
+    if (!view.nextSegment(cursor, segment)) {
+        segment = {};
+    }
+}
+
+template <typename... Components>
+inline QueryView<Components...>::QueryView(EcsContainer& container,
+                                           QueryCacheEntry& entry)
+    : container(&container), entry(&entry) {}
+
+template <typename... Components>
+inline auto QueryView<Components...>::begin() const -> Iterator {
+    container->refreshQuery(*entry);
+    return Iterator(*this);
+}
+
+template <typename... Components>
+inline auto QueryView<Components...>::end() const -> Iterator {
+    return Iterator();
+}
+
+template <typename... Components>
+inline size_t QueryView<Components...>::size() const {
+    container->refreshQuery(*entry);
+    if (container->getStorageMode() == StorageMode::COMPONENT_ARRAYS) {
+        return entry->entities.size();
+    }
+    size_t count = 0;
+    auto const& archetypes = container->componentManager.getArchetypes();
+    for (auto archetype : entry->archetypes) {
+        count += archetypes[archetype]->size();
+    }
+    return count;
+}
+
+template <typename... Components>
+inline bool QueryView<Components...>::empty() const {
+    return size() == 0;
+}
+
+template <typename... Components>
+inline auto QueryView<Components...>::getSegments() const
+    -> std::vector<Segment> {
+    container->refreshQuery(*entry);
+    std::vector<Segment> segments;
+    StorageCursor cursor;
+    Segment segment;
+    while (nextSegment(cursor, segment)) {
+        segments.emplace_back(segment);
+    }
+    return segments;
+}
+
+template <typename... Components>
+template <typename... Filters>
+inline FilteredQueryView<QueryView<Components...>, Filters...>
+QueryView<Components...>::filter(Tick since) const {
+    return FilteredQueryView<QueryView, Filters...>(*this, since);
+}
+
+template <typename... Components>
+template <typename Term>
+inline auto QueryView<Components...>::getColumn(Archetype const& archetype,
+                                                size_t chunk) noexcept
+    -> detail::query_component_t<Term>* {
+    using Component = detail::query_component_t<Term>;
+    if constexpr (detail::is_optional_term_v<Term>) {
+        if (!archetype.getSignature().test(getComponentId<Component>())) {
+            return nullptr;
+        }
+    }
+    return archetype.getColumn<Component>(chunk);
+}
+
+template <typename... Components>
+inline bool QueryView<Components...>::nextSegment(StorageCursor& cursor,
+                                                  Segment& segment) const {
+    auto const& manager = container->componentManager;
+    if (manager.getStorageMode() == StorageMode::COMPONENT_ARRAYS) {
+        if (cursor.archetype == 0 && !entry->entities.empty()) {
+            segment.columns = value_type(
+                reinterpret_cast<detail::query_component_t<Components>*>(
+                    manager[getComponentId<
+                                detail::query_component_t<Components>>()]
+                        .data())...);
+            segment.indices = entry->rows.data();
+            segment.size = entry->entities.size();
+            cursor.archetype = 1;
+            return true;
+        }
+        return false;
+    }
+    auto const& archetypes = manager.getArchetypes();
+    for (; cursor.archetype < entry->archetypes.size();
+         ++cursor.archetype, cursor.chunk = 0) {
+        auto const& archetype = *archetypes[entry->archetypes[cursor.archetype]];
+        while (cursor.chunk < archetype.chunkCount()) {
+            auto chunk = cursor.chunk++;
+            if (auto rows = archetype.getChunk(chunk).size) {
+                segment.columns = value_type(getColumn<Components>(
+                    archetype, chunk)...);
+                segment.indices = nullptr;
+                segment.size = rows;
+                return true;
             }
         }
     }
-    return std::pair(0, nullptr);
+    return false;
+}
+/*======================FilteredQueryView========================================*/
+
+template <typename View, typename... Filters>
+inline FilteredQueryView<View, Filters...>::Iterator::Iterator(
+    base_iterator it, Tick since)
+    : it(it), since(since) {
+    skip();
+}
+
+template <typename View, typename... Filters>
+inline void FilteredQueryView<View, Filters...>::Iterator::skip() noexcept {
+    for (; it != base_iterator(); ++it) {
+        auto components = *it;
+        // missing optional components never pass
+        auto passes = [&]<typename Filter>() {
+            auto* component =
+                std::get<typename Filter::component_type*>(components);
+            return component && Filter::test(*component, since);
+        };
+        if ((passes.template operator()<Filters>() && ...)) {
+            return;
+        }
+    }
 }
 
-inline void ComponentQueryCache::purge(ComponentId const& cId) {
-    for (size_t i = 0; i < cache.size(); ++i) {
-        if (cache[i].bitSig & (1ULL << cId)) {
-            cache[i].dirty = true;
+template <typename View, typename... Filters>
+inline FilteredQueryView<View, Filters...>::FilteredQueryView(View view,
+                                                              Tick since)
+    : view(view), since(since) {}
+
+template <typename View, typename... Filters>
+inline auto FilteredQueryView<View, Filters...>::begin() const -> Iterator {
+    return Iterator(view.begin(), since);
+}
+
+template <typename View, typename... Filters>
+inline auto FilteredQueryView<View, Filters...>::end() const -> Iterator {
+    return Iterator();
+}
+/*======================parallelForEach========================================*/
+
+namespace detail {
+// number of elements in a range: about PARALLEL_RANGE_SIZE bytes, rounded to
+// whole cache lines
+template <typename T>
+constexpr size_t getParallelRangeLength() {
+    constexpr size_t lineLength =
+        CACHE_LINE_SIZE / std::gcd(sizeof(T), CACHE_LINE_SIZE);
+    constexpr size_t length =
+        (PARALLEL_RANGE_SIZE + sizeof(T) - 1) / sizeof(T);
+    return (length + lineLength - 1) / lineLength * lineLength;
+}
+}  // namespace detail
+
+template <typename Component, typename Fn>
+inline void parallelForEach(ThreadPool& pool,
+                            ForEachComponent<Component> components, Fn&& fn) {
+    constexpr size_t rangeLength =
+        detail::getParallelRangeLength<Component>();
+    // every segment starts at a cache line, so do all ranges
+    std::vector<std::pair<Component*, Component*>> ranges;
+    auto segments = components.container.template getSegments<Component>();
+    for (auto [begin, end] : segments) {
+        while (begin != end) {
+            auto* rangeEnd =
+                begin + std::min<ptrdiff_t>(rangeLength, end - begin);
+            ranges.emplace_back(begin, rangeEnd);
+            begin = rangeEnd;
         }
     }
+    pool.parallelFor(ranges.size(), 1, [&](size_t first, size_t last) {
+        for (auto i = first; i < last; ++i) {
+            for (auto* component = ranges[i].first;
+                 component != ranges[i].second; ++component) {
+                fn(*component);
+            }
+        }
+    });
 }
 
-inline QueryCacheEntry& ComponentQueryCache::operator[](size_t i) {
-    return cache[i];
+template <typename... Components, typename Fn>
+inline void parallelForEach(ThreadPool& pool,
+                            QueryView<Components...> const& query, Fn&& fn) {
+    using Segment = typename QueryView<Components...>::Segment;
+    // ranges follow the first column, the ones of other types may share lines
+    using First = detail::query_component_t<
+        std::tuple_element_t<0, std::tuple<Components...>>>;
+    constexpr size_t rangeLength = detail::getParallelRangeLength<First>();
+    std::vector<Segment> ranges;
+    for (auto const& segment : query.getSegments()) {
+        for (size_t begin = 0; begin < segment.size; begin += rangeLength) {
+            ranges.emplace_back(segment.slice(
+                begin, std::min(begin + rangeLength, segment.size)));
+        }
+    }
+    pool.parallelFor(ranges.size(), 1, [&](size_t first, size_t last) {
+        for (auto i = first; i < last; ++i) {
+            for (size_t row = 0; row < ranges[i].size; ++row) {
+                std::apply(fn, ranges[i][row]);
+            }
+        }
+    });
 }
-}  // namespace ecs
\ No newline at end of file
+}  // namespace ecs
@@ -0,0 +1,93 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+namespace detail {
+class EventQueueBase {
+   public:
+    virtual ~EventQueueBase() = default;
+    virtual void swap() = 0;
+};
+
+inline std::atomic<size_t> nextEventTypeId = 0;
+
+template <typename Event>
+size_t getEventTypeId() noexcept {
+    static size_t const id =
+        nextEventTypeId.fetch_add(1, std::memory_order_relaxed);
+    return id;
+}
+}  // namespace detail
+
+/*
+Double buffered array of events of one type. Events sent during a frame become
+readable after swap() and stay readable until the next one, so every reader
+sees each event once no matter if it runs before or after the sender. Not
+thread safe: a queue should have a single writing system at a time.
+*/
+template <typename Event>
+class EventQueue final : public detail::EventQueueBase {
+   public:
+    void send(Event const& event) { pending.emplace_back(event); }
+    template <typename... Args>
+    void emplace(Args&&... args) {
+        pending.emplace_back(std::forward<Args>(args)...);
+    }
+    void send(std::span<Event const> events) {
+        pending.insert(pending.end(), events.begin(), events.end());
+    }
+    // events sent before the last swap
+    std::span<Event const> read() const { return readable; }
+    void swap() override {
+        readable.clear();
+        std::swap(readable, pending);
+    }
+
+   private:
+    std::vector<Event> readable;
+    std::vector<Event> pending;
+};
+
+// one EventQueue per event type, created on first use; creating one is not
+// thread safe either, get() the queues before systems run in parallel
+class EventBus {
+   public:
+    template <typename Event>
+    EventQueue<Event>& get();
+    template <typename Event>
+    void send(Event const& event) {
+        get<Event>().send(event);
+    }
+    template <typename Event>
+    std::span<Event const> read() {
+        return get<Event>().read();
+    }
+    // called once per frame, after all systems sent their events
+    void swap() {
+        for (auto& queue : queues) {
+            if (queue) {
+                queue->swap();
+            }
+        }
+    }
+
+   private:
+    std::vector<std::unique_ptr<detail::EventQueueBase>> queues;
+};
+
+template <typename Event>
+inline EventQueue<Event>& EventBus::get() {
+    auto id = detail::getEventTypeId<Event>();
+    if (id >= queues.size()) {
+        queues.resize(id + 1);
+    }
+    if (!queues[id]) {
+        queues[id] = std::make_unique<EventQueue<Event>>();
+    }
+    return static_cast<EventQueue<Event>&>(*queues[id]);
+}
+}  // namespace ecs
@@ -26,35 +26,8 @@ Entity PrefabFactory::createStaticSprite(ecs::EcsContainer& ecsContainer,
     Collider2D collider;
     collider.add<BoxCollider>(width, height, ColliderType::PHYSICS);
     if (color == Vec4({1, 0, 0, 1})) {
-        collider.setHitboxCallback(
-            0, [ch = CircularBuffer<CollisionHistory, 4>()](
-                   EcsContainer& ecs, Entity entity) mutable {
-                auto* hp = ecs.getComponent<HealthBar>(entity);
-                if (hp) {
-                    bool hit = false;
-                    auto& buff = ch.getBuffer();
-                    auto result =
-                        std::find_if(buff.begin(), buff.end(),
-                                     [entity](CollisionHistory const& a) {
-                                         return a.entity == entity;
-                                     });
-                    if (result != buff.end()) {
-                        if (result->timeStamp.resetIfOlderThanMs(1000)) {
-                            hit = true;
-                        }
-                    } else {
-                        ch.push({entity});
-                        hit = true;
-                    }
-                    if (hit) {
-                        auto dmg =
-                            utils::RandomMatrix<scalar_t>::instance().getScalar(
-                                100, 200);
-                        hp->changeHp(-dmg);
-                        std::cout << "Hit for " << dmg << ".\n";
-                    }
-                }
-            });
+        // damages everything touching it once per second
+        collider.setDamage(0, {100, 200, 1000});
     }
     ecsContainer.addComponent<Collider2D>(entity, std::move(collider));
     ecsContainer.addComponent<StaticSprite>(entity, std::move(sprite));
@@ -203,22 +176,8 @@ Entity PrefabFactory::createAnimatedSprite(ecs::EcsContainer& ecsContainer,
                                   Vec2(0.5f, -0.25f));
         collider.setActive(1, false);
         collider.setActive(2, false);
-
-        auto hitForRandomDmg = [](ecs::EcsContainer& ecsContainer,
-                                  Entity entity) {
-            auto* hp = ecsContainer.getComponent<HealthBar>(entity);
-            if (hp) {
-                auto dmg = utils::RandomMatrix<scalar_t>::instance().getScalar(
-                    10, 300);
-                hp->changeHp(-dmg);
-                std::cout << "Hit an enemy with entity " << entity.getId()
-                          << " for " << dmg << "\n";
-            } else {
-                std::cout << "Entity does not have hp bar\n";
-            }
-        };
-        collider.setHitboxCallback(1, hitForRandomDmg);
-        collider.setHitboxCallback(2, hitForRandomDmg);
+        collider.setDamage(1, {10, 300});
+        collider.setDamage(2, {10, 300});
 
         sprite.getFiniteStateMachine().onState<animation::ATTACK_0>(
             [](ecs::EcsContainer& ecsContainer, ecs::Entity entity, int frame) {
@@ -0,0 +1,191 @@
+#pragma once
+#include "EcsContainer.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+namespace ecs {
+/*
+Keeps the state of the given component types for the last captured frames,
+e.g. for rollback or replays. Components are grouped in pages of PAGE_SIZE
+consecutive entity ids. A capture compares every page with the previous frame
+and copies only the pages that differ, the others are shared between frames.
+
+Components are saved and restored as raw bytes: they have to be trivially
+relocatable, which is checked, and must own nothing, which is not. Restoring
+writes the saved bytes over a live component, so a pointer to memory the
+component frees or a handle it closes would be released twice or leaked even
+in a relocatable type. Only values are rolled back, entities and components
+created or removed since the captured frame stay as they are.
+*/
+template <typename... Components>
+class RollbackBuffer {
+    static_assert((IsTriviallyRelocatable<Components>::value && ...),
+                  "Only trivially relocatable components can be rolled back");
+
+   public:
+    static constexpr size_t PAGE_SIZE = 64;
+
+    explicit RollbackBuffer(size_t frames);
+    void capture(EcsContainer& container);
+    // restores the frame captured the given number of captures before the
+    // last one and drops the newer ones
+    void restore(EcsContainer& container, size_t framesBack = 0);
+    size_t size() const noexcept { return count; }
+    size_t capacity() const noexcept { return frames.size(); }
+    // pages copied by the last capture
+    size_t getCopiedPageCount() const noexcept { return copiedPages; }
+
+   private:
+    template <typename Component>
+    struct Page {
+        std::array<Entity, PAGE_SIZE> owners{};
+        uint64_t present = 0;
+        alignas(Component) byte components[PAGE_SIZE * sizeof(Component)];
+
+        bool holds(size_t slot, Entity const& owner) const noexcept {
+            return (present >> slot & 1) && owners[slot] == owner;
+        }
+        byte* at(size_t slot) noexcept {
+            return components + slot * sizeof(Component);
+        }
+        byte const* at(size_t slot) const noexcept {
+            return components + slot * sizeof(Component);
+        }
+    };
+    template <typename Component>
+    using Pages = std::vector<std::shared_ptr<Page<Component> const>>;
+    using Frame = std::tuple<Pages<Components>...>;
+
+    template <typename Component>
+    void captureType(EcsContainer& container, Frame const* previousFrame,
+                     Pages<Component>& pages);
+    template <typename Component>
+    static void restoreType(EcsContainer& container,
+                            Pages<Component> const& pages);
+
+    std::vector<Frame> frames;
+    size_t newest = 0;
+    size_t count = 0;
+    size_t copiedPages = 0;
+};
+
+template <typename... Components>
+inline RollbackBuffer<Components...>::RollbackBuffer(size_t frames)
+    : frames(frames) {
+    if (frames == 0) {
+        throw std::runtime_error("Rollback buffer needs at least one frame");
+    }
+}
+
+template <typename... Components>
+inline void RollbackBuffer<Components...>::capture(EcsContainer& container) {
+    auto next = count == 0 ? newest : (newest + 1) % frames.size();
+    Frame const* previous = count == 0 ? nullptr : &frames[newest];
+    copiedPages = 0;
+    (captureType<Components>(container, previous,
+                             std::get<Pages<Components>>(frames[next])),
+     ...);
+    newest = next;
+    count = std::min(count + 1, frames.size());
+}
+
+template <typename... Components>
+template <typename Component>
+inline void RollbackBuffer<Components...>::captureType(
+    EcsContainer& container, Frame const* previousFrame,
+    Pages<Component>& pages) {
+    auto const* previous =
+        previousFrame ? &std::get<Pages<Component>>(*previousFrame) : nullptr;
+    // a page differs if one of its components is new, moved to another
+    // entity or changed, or if one was removed
+    std::vector<size_t> counts;
+    std::vector<bool> dirty;
+    for (auto it = container.begin<Component>();
+         it != container.end<Component>(); ++it) {
+        auto const& owner = (*it).getEntity();
+        auto page = owner.getId() / PAGE_SIZE;
+        auto slot = owner.getId() % PAGE_SIZE;
+        if (page >= counts.size()) {
+            counts.resize(page + 1);
+            dirty.resize(page + 1);
+        }
+        ++counts[page];
+        if (dirty[page]) {
+            continue;
+        }
+        auto const* old = previous && page < previous->size()
+                              ? (*previous)[page].get()
+                              : nullptr;
+        dirty[page] = !old || !old->holds(slot, owner) ||
+                      std::memcmp(old->at(slot), &*it, sizeof(Component)) != 0;
+    }
+    pages.assign(counts.size(), nullptr);
+    std::vector<std::shared_ptr<Page<Component>>> copies(counts.size());
+    for (size_t page = 0; page < counts.size(); ++page) {
+        if (counts[page] == 0) {
+            continue;
+        }
+        auto const& old = previous && page < previous->size()
+                              ? (*previous)[page]
+                              : nullptr;
+        if (!dirty[page] && static_cast<size_t>(std::popcount(old->present)) ==
+                                counts[page]) {
+            pages[page] = old;
+        } else {
+            copies[page] = std::make_shared<Page<Component>>();
+            pages[page] = copies[page];
+            ++copiedPages;
+        }
+    }
+    for (auto it = container.begin<Component>();
+         it != container.end<Component>(); ++it) {
+        auto const& owner = (*it).getEntity();
+        auto& copy = copies[owner.getId() / PAGE_SIZE];
+        if (copy) {
+            auto slot = owner.getId() % PAGE_SIZE;
+            copy->owners[slot] = owner;
+            copy->present |= uint64_t{1} << slot;
+            std::memcpy(copy->at(slot), &*it, sizeof(Component));
+        }
+    }
+}
+
+template <typename... Components>
+inline void RollbackBuffer<Components...>::restore(EcsContainer& container,
+                                                   size_t framesBack) {
+    if (framesBack >= count) {
+        throw std::runtime_error("Frame is not in the rollback buffer");
+    }
+    newest = (newest + frames.size() - framesBack) % frames.size();
+    count -= framesBack;
+    (restoreType<Components>(container,
+                             std::get<Pages<Components>>(frames[newest])),
+     ...);
+}
+
+template <typename... Components>
+template <typename Component>
+inline void RollbackBuffer<Components...>::restoreType(
+    EcsContainer& container, Pages<Component> const& pages) {
+    for (auto it = container.begin<Component>();
+         it != container.end<Component>(); ++it) {
+        auto& component = *it;
+        auto const& owner = component.getEntity();
+        auto page = owner.getId() / PAGE_SIZE;
+        auto slot = owner.getId() % PAGE_SIZE;
+        auto const* saved = page < pages.size() ? pages[page].get() : nullptr;
+        if (saved && saved->holds(slot, owner) &&
+            std::memcmp(saved->at(slot), &component, sizeof(Component)) != 0) {
+            std::memcpy(static_cast<void*>(&component), saved->at(slot),
+                        sizeof(Component));
+            component.markChanged();
+        }
+    }
+}
+}  // namespace ecs
@@ -0,0 +1,122 @@
+#include "SystemScheduler.h"
+#include <algorithm>
+
+namespace ecs {
+SystemScheduler::SystemScheduler(ThreadPool& pool) : pool(pool) {}
+
+size_t SystemScheduler::addSystem(std::string name, SystemAccess access,
+                                  system_fn fn) {
+    SystemNode node;
+    node.name = std::move(name);
+    node.access = access;
+    node.fn = std::move(fn);
+    size_t index = systems.size();
+    for (auto& other : systems) {
+        if (conflict(other.access, access)) {
+            other.dependents.push_back(index);
+            ++node.dependencyCount;
+        }
+    }
+    systems.emplace_back(std::move(node));
+    return index;
+}
+
+bool SystemScheduler::conflict(SystemAccess const& a, SystemAccess const& b) {
+    return a.exclusive || b.exclusive ||
+           a.writes.intersects(b.reads | b.writes) ||
+           b.writes.intersects(a.reads);
+}
+
+std::vector<size_t> SystemScheduler::getDependencies(size_t system) const {
+    std::vector<size_t> dependencies;
+    for (size_t i = 0; i < system; ++i) {
+        auto const& dependents = systems[i].dependents;
+        if (std::find(dependents.begin(), dependents.end(), system) !=
+            dependents.end()) {
+            dependencies.push_back(i);
+        }
+    }
+    return dependencies;
+}
+
+void SystemScheduler::run(scalar_t dt) {
+    if (systems.empty()) {
+        return;
+    }
+    {
+        std::lock_guard lock(mutex);
+        remaining = systems.size();
+        error = nullptr;
+        for (auto& system : systems) {
+            system.pending = system.dependencyCount;
+        }
+    }
+    for (size_t i = 0; i < systems.size(); ++i) {
+        if (systems[i].dependencyCount == 0) {
+            schedule(i, dt);
+        }
+    }
+    // exclusive systems run here, on the calling thread
+    std::unique_lock lock(mutex);
+    while (remaining > 0) {
+        done.wait(lock,
+                  [this] { return remaining == 0 || !readyExclusive.empty(); });
+        if (readyExclusive.empty()) {
+            continue;
+        }
+        auto system = readyExclusive.back();
+        readyExclusive.pop_back();
+        lock.unlock();
+        try {
+            systems[system].fn(dt);
+        } catch (...) {
+            std::lock_guard errorLock(mutex);
+            error = std::current_exception();
+        }
+        finish(system, dt);
+        lock.lock();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+void SystemScheduler::schedule(size_t system, scalar_t dt) {
+    if (systems[system].access.exclusive) {
+        {
+            std::lock_guard lock(mutex);
+            readyExclusive.push_back(system);
+        }
+        done.notify_one();
+        return;
+    }
+    pool.submit([this, system, dt] {
+        try {
+            systems[system].fn(dt);
+        } catch (...) {
+            std::lock_guard lock(mutex);
+            error = std::current_exception();
+        }
+        finish(system, dt);
+    });
+}
+
+void SystemScheduler::finish(size_t system, scalar_t dt) {
+    std::vector<size_t> ready;
+    {
+        std::lock_guard lock(mutex);
+        for (auto dependent : systems[system].dependents) {
+            if (--systems[dependent].pending == 0) {
+                ready.push_back(dependent);
+            }
+        }
+    }
+    for (auto dependent : ready) {
+        schedule(dependent, dt);
+    }
+    // notified under the lock, run() may return as soon as it is released
+    std::lock_guard lock(mutex);
+    --remaining;
+    done.notify_one();
+}
+}  // namespace ecs
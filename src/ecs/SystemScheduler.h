@@ -0,0 +1,77 @@
+#pragma once
+#include "EcsContainer.h"
+#include "../ThreadPool.h"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace ecs {
+// components touched by a system, used to decide which systems can run at the
+// same time
+struct SystemAccess {
+    ComponentSig reads;
+    ComponentSig writes;
+    // runs alone on the calling thread, for systems making structural changes,
+    // calling user callbacks or using the rendering context
+    bool exclusive = false;
+};
+
+inline SystemAccess exclusive() {
+    SystemAccess access;
+    access.exclusive = true;
+    return access;
+}
+
+template <typename... Components>
+SystemAccess reads(SystemAccess access = {}) {
+    access.reads |= getComponentSig<Components...>();
+    return access;
+}
+
+template <typename... Components>
+SystemAccess writes(SystemAccess access = {}) {
+    access.writes |= getComponentSig<Components...>();
+    return access;
+}
+
+/*
+Runs registered systems once per frame. Systems that conflict (one writes what
+the other reads or writes) keep their registration order, all others can run
+concurrently on the thread pool.
+*/
+class SystemScheduler {
+   public:
+    using system_fn = std::function<void(scalar_t)>;
+
+    explicit SystemScheduler(ThreadPool& pool);
+    size_t addSystem(std::string name, SystemAccess access, system_fn fn);
+    void run(scalar_t dt);
+    // indices of systems that have to finish before the given one starts
+    std::vector<size_t> getDependencies(size_t system) const;
+    static bool conflict(SystemAccess const& a, SystemAccess const& b);
+
+   private:
+    struct SystemNode {
+        std::string name;
+        SystemAccess access;
+        system_fn fn;
+        std::vector<size_t> dependents;
+        size_t dependencyCount = 0;
+        size_t pending = 0;
+    };
+
+    void schedule(size_t system, scalar_t dt);
+    void finish(size_t system, scalar_t dt);
+
+    ThreadPool& pool;
+    std::vector<SystemNode> systems;
+    std::mutex mutex;
+    std::condition_variable done;
+    size_t remaining = 0;
+    std::vector<size_t> readyExclusive;
+    std::exception_ptr error;
+};
+}  // namespace ecs
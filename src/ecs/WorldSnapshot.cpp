@@ -0,0 +1,95 @@
+#include "WorldSnapshot.h"
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace ecs {
+#ifdef _WIN32
+MappedFile::MappedFile(std::string const& path) {
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        file = nullptr;
+        throw std::runtime_error("Cannot open " + path);
+    }
+    LARGE_INTEGER fileSize;
+    GetFileSizeEx(file, &fileSize);
+    length = static_cast<size_t>(fileSize.QuadPart);
+    if (length == 0) {
+        return;
+    }
+    mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping) {
+        memory = static_cast<byte*>(
+            MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    }
+    if (!memory) {
+        this->~MappedFile();
+        throw std::runtime_error("Cannot map " + path);
+    }
+}
+
+MappedFile::~MappedFile() {
+    if (memory) {
+        UnmapViewOfFile(memory);
+        memory = nullptr;
+    }
+    if (mapping) {
+        CloseHandle(mapping);
+        mapping = nullptr;
+    }
+    if (file) {
+        CloseHandle(file);
+        file = nullptr;
+    }
+}
+#else
+MappedFile::MappedFile(std::string const& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read the size of " + path);
+    }
+    length = static_cast<size_t>(status.st_size);
+    if (length > 0) {
+        void* address = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        memory = static_cast<byte*>(address);
+    }
+    // the mapping keeps its own reference to the file
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (memory) {
+        munmap(memory, length);
+    }
+}
+#endif
+
+void WorldSnapshot::clearVtable(byte* component) noexcept {
+    std::memset(component, 0, sizeof(void*));
+}
+
+byte const* WorldSnapshot::at(MappedFile const& file, uint64_t offset,
+                              uint64_t bytes) {
+    if (offset > file.size() || bytes > file.size() - offset) {
+        throw std::runtime_error("Snapshot file is truncated");
+    }
+    return file.data() + offset;
+}
+}  // namespace ecs
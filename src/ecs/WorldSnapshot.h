@@ -0,0 +1,271 @@
+#pragma once
+#include "EcsContainer.h"
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ecs {
+// private, copy on write mapping of a whole file, pages are read on first
+// access and modifications never reach the file
+class MappedFile {
+   public:
+    explicit MappedFile(std::string const& path);
+    ~MappedFile();
+    MappedFile(MappedFile const&) = delete;
+    MappedFile& operator=(MappedFile const&) = delete;
+
+    byte* data() const noexcept { return memory; }
+    size_t size() const noexcept { return length; }
+
+   private:
+    byte* memory = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#endif
+};
+
+/*
+Versioned binary snapshot of the entities of a container and of the components
+of the given types, e.g.
+WorldSnapshot::save<Transform2D, Physics2D>(ecs, "level.snapshot");
+
+The file holds a header, every entity slot (live and free), a table of columns
+and for each column the owning entities followed by the cache line aligned
+bytes of its components, written in one pass. Loading maps the file and moves
+the components into the container.
+
+Components are stored as they are in memory, so only trivially relocatable
+types holding no pointers besides their vtable can be saved. The vtable
+pointer is written as zero, it is never read back: moving a component into
+the container gives it the vtable of the running build and the mapped bytes
+are not destroyed.
+*/
+class WorldSnapshot {
+   public:
+    static constexpr uint32_t VERSION = 1;
+
+    template <typename... Components>
+    static void save(EcsContainer& container, std::string const& path);
+    // the container must not have created any entity yet; the file is
+    // checked before the container is touched, if adding the components
+    // fails after all (out of memory) the container has to be thrown away
+    template <typename... Components>
+    static void load(EcsContainer& container, std::string const& path);
+
+   private:
+    struct Header {
+        std::array<char, 4> magic{'E', 'C', 'S', 'S'};
+        uint32_t version = VERSION;
+        uint32_t handleSize = sizeof(EntityHandle);
+        uint32_t indexBits = ENTITY_INDEX_BITS;
+        uint64_t slotCount = 0;
+        uint64_t firstFree = 0;
+        uint64_t freeCount = 0;
+        uint64_t columnCount = 0;
+    };
+
+    struct Column {
+        uint64_t componentId = 0;
+        uint64_t size = 0;
+        uint64_t alignment = 0;
+        uint64_t count = 0;
+        uint64_t ownersOffset = 0;  // count entities
+        uint64_t dataOffset = 0;    // count components
+    };
+
+    // the vtable pointer is the first word of every component
+    static void clearVtable(byte* component) noexcept;
+    static byte const* at(MappedFile const& file, uint64_t offset,
+                          uint64_t bytes);
+    template <typename Component>
+    static Column describe(EcsContainer& container);
+    template <typename Component>
+    static void writeColumn(std::ofstream& out, EcsContainer& container,
+                            Column const& column);
+    template <typename Component>
+    static void checkColumn(MappedFile const& file, Column const& column,
+                            std::span<Entity const> slots,
+                            std::vector<bool>& owned);
+    template <typename Component>
+    static void loadColumn(EcsContainer& container, MappedFile const& file,
+                           Column const& column);
+};
+
+template <typename Component>
+inline WorldSnapshot::Column WorldSnapshot::describe(EcsContainer& container) {
+    static_assert(IsTriviallyRelocatable<Component>::value,
+                  "Only trivially relocatable components can be saved");
+    Column column;
+    column.componentId = getComponentId<Component>();
+    column.size = sizeof(Component);
+    column.alignment = alignof(Component);
+    column.count = container.componentManager.getComponentCount(
+        getComponentId<Component>());
+    return column;
+}
+
+template <typename Component>
+inline void WorldSnapshot::writeColumn(std::ofstream& out,
+                                       EcsContainer& container,
+                                       Column const& column) {
+    std::vector<Entity> owners;
+    owners.reserve(column.count);
+    std::vector<byte> components(column.count * sizeof(Component));
+    auto* component = components.data();
+    for (auto it = container.begin<Component>();
+         it != container.end<Component>(); ++it) {
+        owners.emplace_back((*it).getEntity());
+        std::memcpy(component, &*it, sizeof(Component));
+        clearVtable(component);
+        component += sizeof(Component);
+    }
+    out.write(reinterpret_cast<char const*>(owners.data()),
+              owners.size() * sizeof(Entity));
+    while (static_cast<uint64_t>(out.tellp()) < column.dataOffset) {
+        out.put(0);
+    }
+    out.write(reinterpret_cast<char const*>(components.data()),
+              components.size());
+}
+
+template <typename... Components>
+inline void WorldSnapshot::save(EcsContainer& container,
+                                std::string const& path) {
+    static_assert(sizeof(Entity) == sizeof(EntityHandle));
+    auto const& slots = container.entityManager.getEntitites();
+    Header header;
+    header.slotCount = slots.size();
+    header.firstFree = container.entityManager.getFirstFree();
+    header.freeCount = container.entityManager.getFreeCount();
+    header.columnCount = sizeof...(Components);
+    std::array<Column, sizeof...(Components)> columns{
+        describe<Components>(container)...};
+    uint64_t offset = sizeof(Header) + slots.size() * sizeof(Entity) +
+                      columns.size() * sizeof(Column);
+    for (auto& column : columns) {
+        column.ownersOffset = offset;
+        offset += column.count * sizeof(Entity);
+        offset = (offset + CACHE_LINE_SIZE - 1) & ~(CACHE_LINE_SIZE - 1);
+        column.dataOffset = offset;
+        offset += column.count * column.size;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Cannot open snapshot file " + path);
+    }
+    out.write(reinterpret_cast<char const*>(&header), sizeof(Header));
+    out.write(reinterpret_cast<char const*>(slots.data()),
+              slots.size() * sizeof(Entity));
+    out.write(reinterpret_cast<char const*>(columns.data()),
+              columns.size() * sizeof(Column));
+    size_t i = 0;
+    (writeColumn<Components>(out, container, columns[i++]), ...);
+    if (!out) {
+        throw std::runtime_error("Cannot write snapshot file " + path);
+    }
+}
+
+// owned is a scratch buffer of one flag per slot
+template <typename Component>
+inline void WorldSnapshot::checkColumn(MappedFile const& file,
+                                       Column const& column,
+                                       std::span<Entity const> slots,
+                                       std::vector<bool>& owned) {
+    if (column.componentId != getComponentId<Component>() ||
+        column.size != sizeof(Component) ||
+        column.alignment != alignof(Component)) {
+        throw std::runtime_error("Snapshot component types do not match");
+    }
+    auto const* owners = reinterpret_cast<Entity const*>(
+        at(file, column.ownersOffset, column.count * sizeof(Entity)));
+    at(file, column.dataOffset, column.count * sizeof(Component));
+    if (column.dataOffset % alignof(Component) != 0) {
+        throw std::runtime_error("Snapshot component column is misaligned");
+    }
+    // live owners only, each at most once
+    owned.assign(slots.size(), false);
+    for (size_t i = 0; i < column.count; ++i) {
+        auto id = owners[i].getId();
+        if (id >= slots.size() || slots[id] != owners[i] || owned[id]) {
+            throw std::runtime_error("Snapshot component owner is invalid");
+        }
+        owned[id] = true;
+    }
+}
+
+template <typename Component>
+inline void WorldSnapshot::loadColumn(EcsContainer& container,
+                                      MappedFile const& file,
+                                      Column const& column) {
+    auto const* owners =
+        reinterpret_cast<Entity const*>(file.data() + column.ownersOffset);
+    auto* bytes = file.data() + column.dataOffset;
+    // owners were checked by checkColumn
+    for (size_t i = 0; i < column.count; ++i, bytes += sizeof(Component)) {
+        // the move constructor copies the members and never calls through
+        // the cleared vtable, the mapped bytes are not destroyed
+        auto* component = std::launder(reinterpret_cast<Component*>(bytes));
+        container.addComponent<Component>(owners[i], std::move(*component));
+    }
+}
+
+template <typename... Components>
+inline void WorldSnapshot::load(EcsContainer& container,
+                                std::string const& path) {
+    if (container.getMaximumEntityCount() != 0) {
+        throw std::runtime_error(
+            "Snapshots can only be loaded into an empty container");
+    }
+    MappedFile file(path);
+    Header header;
+    std::memcpy(&header, at(file, 0, sizeof(Header)), sizeof(Header));
+    if (header.magic != Header{}.magic) {
+        throw std::runtime_error(path + " is not a snapshot file");
+    }
+    if (header.version != VERSION ||
+        header.handleSize != sizeof(EntityHandle) ||
+        header.indexBits != ENTITY_INDEX_BITS) {
+        throw std::runtime_error("Unsupported snapshot version of " + path);
+    }
+    if (header.columnCount != sizeof...(Components)) {
+        throw std::runtime_error("Snapshot component types do not match");
+    }
+    auto const* slots = reinterpret_cast<Entity const*>(
+        at(file, sizeof(Header), header.slotCount * sizeof(Entity)));
+    std::array<Column, sizeof...(Components)> columns;
+    std::memcpy(columns.data(),
+                at(file, sizeof(Header) + header.slotCount * sizeof(Entity),
+                   columns.size() * sizeof(Column)),
+                columns.size() * sizeof(Column));
+    std::span<Entity const> slotSpan(slots, header.slotCount);
+    std::vector<bool> owned;
+    size_t i = 0;
+    (checkColumn<Components>(file, columns[i++], slotSpan, owned), ...);
+
+    container.entityManager.restore(slotSpan,
+                                    static_cast<EntityId>(header.firstFree),
+                                    header.freeCount);
+    if (header.slotCount > 0) {
+        container.componentManager.addEntity(
+            Entity(static_cast<EntityId>(header.slotCount - 1), 0));
+    }
+    container.beginBatch();
+    try {
+        i = 0;
+        (loadColumn<Components>(container, file, columns[i++]), ...);
+    } catch (...) {
+        container.endBatch();
+        throw;
+    }
+    container.endBatch();
+}
+}  // namespace ecs
@@ -23,6 +23,8 @@ namespace ecs {
 class AnimatedSprite
     : public ComponentBase<AnimatedSprite, AnimatedSpriteTag, ComponentTags> {
    public:
+    static constexpr bool trivially_relocatable = true;
+
     using TransitionFunction = bool (*)(ecs::EcsContainer&, ecs::Entity);
     using ActionFunction = void (*)(ecs::EcsContainer&, ecs::Entity,
                                     int currentFrameOfState);
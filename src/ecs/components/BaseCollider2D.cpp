@@ -15,13 +15,6 @@ void BaseCollider2D::addModelSpaceData(ColliderData&& data) {
     this->modelSpaceData.emplace_back(std::move(data));
 }
 
-void BaseCollider2D::setHitboxCallback(CallbackType fn) { hitboxCallback = fn; }
-
-void BaseCollider2D::notifyHitbox(ecs::EcsContainer& ecsContainer,
-                                  ecs::Entity const& other) const {
-    if (hitboxCallback) hitboxCallback(ecsContainer, other);
-}
-
 void BaseCollider2D::translateInWorldSpace(Vec2 const& position) {
     worldSpacePosition[0] += position[0];
     worldSpacePosition[1] += position[1];
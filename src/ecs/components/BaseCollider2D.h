@@ -1,6 +1,5 @@
 #pragma once
 #include <vector>
-#include <functional>
 #include "../../Types.h"
 #include "../EcsContainer.h"
 
@@ -11,9 +10,16 @@ struct ColliderData {
     Vec4 vertex;
     Vec2 normal;
 };
+// random damage dealt to entities touched by a collider, none if max is 0
+struct DamageRange {
+    scalar_t min = 0;
+    scalar_t max = 0;
+    // a physics collider with a cooldown hits again while touching
+    long long cooldownMs = 0;
+};
+
 class BaseCollider2D {
    public:
-    using CallbackType = std::function<void(ecs::EcsContainer&, ecs::Entity)>;
     void update(Mat4 const& modelToWorld, Mat2 const& normalsRotation,
                 scalar_t scaleFactor);
     inline auto const& getWorldSpaceData() const {
@@ -31,9 +37,8 @@ class BaseCollider2D {
     inline scalar_t getRadius() const { return radius; }
     inline bool isActive() const { return active; }
     inline void setActive(bool value) { active = value; }
-    void notifyHitbox(ecs::EcsContainer& ecsContainer,
-                      ecs::Entity const& other) const;
-    void setHitboxCallback(CallbackType fn);
+    inline DamageRange const& getDamage() const { return damage; }
+    inline void setDamage(DamageRange const& value) { damage = value; }
     virtual ~BaseCollider2D() {}
 
    protected:
@@ -52,7 +57,7 @@ class BaseCollider2D {
     std::vector<ColliderData> worldSpaceData{};
     Vec4 localSpacePosition{};
     Vec4 worldSpacePosition{};
-    CallbackType hitboxCallback = nullptr;
+    DamageRange damage{};
     Shape shape = Shape::POLYGON;
     ColliderType type = ColliderType::PHYSICS;
     scalar_t radius{};
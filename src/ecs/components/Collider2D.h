@@ -1,6 +1,5 @@
 #pragma once
 #include "../../Types.h"
-#include "../../CircularBuffer.h"
 #include "../../EngineConstants.h"
 #include "BaseCollider2D.h"
 #include "../../Utils.h"
@@ -9,14 +8,6 @@
 #include <vector>
 #include <memory>
 
-struct CollisionHistory {
-    CollisionHistory() : entity({}), timeStamp({}) {}
-    CollisionHistory(ecs::Entity const& entity)
-        : entity(entity), timeStamp({}) {}
-    ecs::Entity entity;
-    utils::TimeStamp timeStamp;
-};
-
 class Collider2D : public ecs::ComponentBase<Collider2D, ecs::Collider2DTag,
                                              ecs::ComponentTags> {
    public:
@@ -29,6 +20,7 @@ class Collider2D : public ecs::ComponentBase<Collider2D, ecs::Collider2DTag,
     int add(Args&&... args) {
         colliders.emplace_back(
             std::make_unique<T>(std::forward<Args>(args)...));
+        markChanged();  // world space vertices are computed on next update
         return colliders.size() - 1;
     }
     // scaling needed to update radius in circle collider
@@ -37,11 +29,11 @@ class Collider2D : public ecs::ComponentBase<Collider2D, ecs::Collider2DTag,
     inline auto const& getColliders() const { return colliders; }
     inline void setActive(int id, bool value) {
         colliders[id]->setActive(value);
+        markChanged();  // changes the bounding box
     }
     inline bool isActive(int id) const { return colliders[id]->isActive(); }
-    inline void setHitboxCallback(int colliderId,
-                                  BaseCollider2D::CallbackType fn) {
-        colliders[colliderId]->setHitboxCallback(fn);
+    inline void setDamage(int colliderId, DamageRange const& damage) {
+        colliders[colliderId]->setDamage(damage);
     }
     bool setCurrentHitboxTarget(
         ecs::Entity const&
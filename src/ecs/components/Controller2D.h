@@ -7,6 +7,8 @@ class Controller2D
     : public ecs::ComponentBase<Controller2D, ecs::Controller2DTag,
                                 ecs::ComponentTags> {
    public:
+    static constexpr bool trivially_relocatable = true;
+
     void moveUp(ecs::EcsContainer& ecsContainer, scalar_t dt);
     void moveDown(ecs::EcsContainer& ecsContainer, scalar_t dt);
     void moveLeft(ecs::EcsContainer& ecsContainer, scalar_t dt);
@@ -8,6 +8,8 @@
 class HealthBar : public ecs::ComponentBase<HealthBar, ecs::HealthBarTag,
                                             ecs::ComponentTags> {
    public:
+    static constexpr bool trivially_relocatable = true;
+
     HealthBar(scalar_t maxValue, float floatHeight);
     void changeHp(scalar_t amount);
     void reset();
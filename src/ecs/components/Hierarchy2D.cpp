@@ -0,0 +1,9 @@
+#include "Hierarchy2D.h"
+
+Hierarchy2D::Hierarchy2D(ecs::Entity const& parent) : parent(parent) {}
+
+void Hierarchy2D::setParent(ecs::Entity const& parent) {
+    this->parent = parent;
+    synced = false;
+    markChanged();
+}
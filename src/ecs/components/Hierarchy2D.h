@@ -0,0 +1,31 @@
+#pragma once
+#include "../../Types.h"
+#include "../EcsContainer.h"
+#include "../EcsComponentList.h"
+
+namespace ecs {
+class HierarchySystem;
+}
+
+// attaches the Transform2D of an entity to the Transform2D of its parent, the
+// HierarchySystem keeps the parent's world transform in the child's one
+class Hierarchy2D : public ecs::ComponentBase<Hierarchy2D, ecs::Hierarchy2DTag,
+                                              ecs::ComponentTags> {
+   public:
+    static constexpr bool trivially_relocatable = true;
+
+    explicit Hierarchy2D(ecs::Entity const& parent);
+    inline ecs::Entity getParent() const { return parent; }
+    void setParent(ecs::Entity const& parent);
+    // number of ancestors, up to date after the HierarchySystem ran
+    inline uint32_t getDepth() const { return depth; }
+
+   private:
+    friend class ecs::HierarchySystem;
+
+    ecs::Entity parent;
+    // changed tick of the parent's transform when it was last propagated
+    ecs::Tick parentTick = 0;
+    uint32_t depth = 0;
+    bool synced = false;
+};
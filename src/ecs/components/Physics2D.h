@@ -6,6 +6,8 @@
 class Physics2D : public ecs::ComponentBase<Physics2D, ecs::Physics2DTag,
                                             ecs::ComponentTags> {
    public:
+    static constexpr bool trivially_relocatable = true;
+
     inline void setMass(scalar_t mass) { this->mass = mass; }
     inline auto getMass() const { return mass; }
     inline auto getFriction() const { return friction; }
@@ -27,13 +27,21 @@ StaticSprite::StaticSprite(Vec4 const& color, scalar_t width, scalar_t height) {
 
 QuadMesh StaticSprite::getMesh() { return mesh; }
 
+void StaticSprite::updateWorldMesh(Mat4 const& modelToWorld, scalar_t depth) {
+    worldMesh = mesh;
+    worldMesh.transformPosition(modelToWorld);
+    worldMesh.setDepth(depth);
+}
+
 Texture const* StaticSprite::getTexture() const { return texture; }
 
 // Assumes that the frame belongs to the stored texture atlas
 void StaticSprite::setNormalMap(TextureAtlasFrame const& frame) {
     mesh.setNormalTexCoords(frame.getTextureRect());
+    markChanged();
 }
 void StaticSprite::rotate(scalar_t degreeAngle) {
     mesh.transformPosition(math::getRotationMatrix(degreeAngle));
+    markChanged();
 }
 }  // namespace ecs
\ No newline at end of file
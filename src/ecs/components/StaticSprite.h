@@ -11,12 +11,17 @@ namespace ecs {
 class StaticSprite
     : public ComponentBase<StaticSprite, StaticSpriteTag, ComponentTags> {
    public:
+    static constexpr bool trivially_relocatable = true;
+
     StaticSprite(Texture const& singleTexture, scalar_t width, scalar_t height);
     StaticSprite(Texture const& atlasTexture, TextureAtlasFrame const& frame,
                  scalar_t width, scalar_t height,
                  bool preserveAspectRatio = true);
     StaticSprite(Vec4 const& color, scalar_t width, scalar_t height);
     QuadMesh getMesh();  // copy to transform later
+    // mesh in world space, valid after the last updateWorldMesh
+    QuadMesh const& getWorldMesh() const { return worldMesh; }
+    void updateWorldMesh(Mat4 const& modelToWorld, scalar_t depth);
     Texture const* getTexture() const;
     bool isOpaque() const { return opaque; }
     inline void setOpaque(bool value) { opaque = value; }
@@ -25,6 +30,7 @@ class StaticSprite
 
    private:
     QuadMesh mesh;
+    QuadMesh worldMesh;
     Texture const* texture = nullptr;
     bool opaque;
 };
@@ -7,24 +7,33 @@ void Transform2D::updateModelMatrix() {
     if (shouldFlipY) {
         math::negateX(modelMatrix);
     }
+    if (parented) {
+        this->modelMatrix = parentMatrix * modelMatrix;
+    }
     this->modelMatrix(2, 2) = depth;
     shouldUpdateModelMatrix = false;
 }
 void Transform2D::updateNormalsMatrix() {
     this->normalsMatrix = math::get2x2RotationMatrix2D(this->rotationAngle);
+    if (parented) {
+        this->normalsMatrix = parentNormalsMatrix * normalsMatrix;
+    }
 }
 void Transform2D::translate(Displacement2D const& displacement) {
     this->position += displacement;
     this->shouldUpdateModelMatrix = true;
+    markChanged();
 }
 void Transform2D::rotate(DegreeAngle const angle) {
     this->rotationAngle += angle;
     this->shouldUpdateModelMatrix = true;
     this->shouldUpdateNormalsMatrix = true;
+    markChanged();
 }
 void Transform2D::scale(scalar_t const scale) {
     this->scaleFactor += scale;
     this->shouldUpdateModelMatrix = true;
+    markChanged();
 }
 Vec2 Transform2D::up() const {
     auto m = math::getRotationMatrix(this->rotationAngle);
@@ -64,6 +73,26 @@ Mat2 const& Transform2D::normalsRotation() {
     return normalsMatrix;
 }
 
+void Transform2D::setParentTransform(Mat4 const& modelToWorld,
+                                     Mat2 const& normalsRotation,
+                                     scalar_t scale) {
+    this->parentMatrix = modelToWorld;
+    this->parentNormalsMatrix = normalsRotation;
+    this->parentScaleFactor = scale;
+    this->parented = true;
+    this->shouldUpdateModelMatrix = true;
+    this->shouldUpdateNormalsMatrix = true;
+    markChanged();
+}
+
+void Transform2D::clearParentTransform() {
+    this->parentScaleFactor = 1;
+    this->parented = false;
+    this->shouldUpdateModelMatrix = true;
+    this->shouldUpdateNormalsMatrix = true;
+    markChanged();
+}
+
 void Transform2D::setNdcDepth(scalar_t depth) {
     if (depth > 0.99f) {
         depth = 0.99f;
@@ -72,4 +101,6 @@ void Transform2D::setNdcDepth(scalar_t depth) {
         depth = -0.99f;
     }
     this->depth = depth;
+    this->shouldUpdateModelMatrix = true;
+    markChanged();
 }
\ No newline at end of file
@@ -6,11 +6,21 @@
 class Transform2D : public ecs::ComponentBase<Transform2D, ecs::Transform2DTag,
                                               ecs::ComponentTags> {
    public:
+    static constexpr bool trivially_relocatable = true;
+
     void translate(Displacement2D const& displacement);
     void rotate(DegreeAngle const angle);
     void scale(scalar_t const scale);
-    inline void setFlipY(bool value) { shouldFlipY = value; };
-    inline void flipY() { shouldFlipY = !shouldFlipY; }
+    inline void setFlipY(bool value) {
+        shouldFlipY = value;
+        shouldUpdateModelMatrix = true;
+        markChanged();
+    };
+    inline void flipY() {
+        shouldFlipY = !shouldFlipY;
+        shouldUpdateModelMatrix = true;
+        markChanged();
+    }
     Mat4 const& modelToWorld();
     Mat2 const& normalsRotation();
     Mat4 getRotationMatrix() const;
@@ -18,18 +28,34 @@ class Transform2D : public ecs::ComponentBase<Transform2D, ecs::Transform2DTag,
     Mat4 getScalingMatrix() const;
     DegreeAngle getRotationAngle() const;
     inline scalar_t getScaleFactor() const { return scaleFactor; }
+    // scale including the scale of the parents
+    inline scalar_t getWorldScaleFactor() const {
+        return parentScaleFactor * scaleFactor;
+    }
     inline Position2D getPosition() const { return position; }
     inline void setPosition(Position2D const& position) {
         this->position = position;
+        shouldUpdateModelMatrix = true;
+        markChanged();
+    }
+    inline void setX(scalar_t x) {
+        this->position[0] = x;
+        shouldUpdateModelMatrix = true;
+        markChanged();
+    }
+    inline void setY(scalar_t y) {
+        this->position[1] = y;
+        shouldUpdateModelMatrix = true;
+        markChanged();
     }
-    inline void setX(scalar_t x) { this->position[0] = x; }
-    inline void setY(scalar_t y) { this->position[1] = y; }
     inline scalar_t getX() { return this->position[0]; }
     inline scalar_t getY() { return this->position[1]; }
     void setNdcDepth(scalar_t depth);
     inline scalar_t getNdcDepth() const { return depth; }
     inline void subtractPosition(Position2D const& vec) {
         this->position -= vec;
+        shouldUpdateModelMatrix = true;
+        markChanged();
     }
     /*returns the normalized green(Y) vector in the world space*/
     Vec2 up() const;
@@ -37,10 +63,19 @@ class Transform2D : public ecs::ComponentBase<Transform2D, ecs::Transform2DTag,
     Vec2 right() const;
     void updateModelMatrix();
     void updateNormalsMatrix();
+    /*world transform of the parent, applied after the local one; set by the
+    HierarchySystem*/
+    void setParentTransform(Mat4 const& modelToWorld,
+                            Mat2 const& normalsRotation, scalar_t scale);
+    void clearParentTransform();
+    inline bool hasParent() const { return parented; }
 
    private:
     Mat4 modelMatrix;
     Mat2 normalsMatrix;
+    Mat4 parentMatrix;
+    Mat2 parentNormalsMatrix;
+    scalar_t parentScaleFactor = 1;
     Position2D position;
     DegreeAngle rotationAngle = 0;
     scalar_t scaleFactor = 1;
@@ -48,4 +83,5 @@ class Transform2D : public ecs::ComponentBase<Transform2D, ecs::Transform2DTag,
     bool shouldUpdateModelMatrix = true;
     bool shouldUpdateNormalsMatrix = true;
     bool shouldFlipY = false;
+    bool parented = false;
 };
\ No newline at end of file
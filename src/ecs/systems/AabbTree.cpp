@@ -0,0 +1,177 @@
+#include "AabbTree.h"
+#include <utility>
+
+namespace ecs {
+int AabbTree::insert(Aabb const& box, uint32_t userData) {
+    auto leaf = allocateNode();
+    nodes[leaf].box = box.fattened(margin);
+    nodes[leaf].userData = userData;
+    insertLeaf(leaf);
+    ++leafCount;
+    return leaf;
+}
+
+void AabbTree::remove(int proxy) {
+    removeLeaf(proxy);
+    freeNode(proxy);
+    --leafCount;
+}
+
+bool AabbTree::move(int proxy, Aabb const& box) {
+    auto const& fatBox = nodes[proxy].box;
+    // a box that shrank a lot would keep reporting stale pairs
+    if (fatBox.contains(box) && !fatBox.contains(box.fattened(4 * margin))) {
+        return false;
+    }
+    removeLeaf(proxy);
+    nodes[proxy].box = box.fattened(margin);
+    insertLeaf(proxy);
+    return true;
+}
+
+void AabbTree::clear() {
+    nodes.clear();
+    root = NULL_NODE;
+    freeList = NULL_NODE;
+    leafCount = 0;
+}
+
+int AabbTree::getHeight() const noexcept {
+    return root == NULL_NODE ? -1 : nodes[root].height;
+}
+
+int AabbTree::allocateNode() {
+    if (freeList == NULL_NODE) {
+        nodes.emplace_back();
+        return static_cast<int>(nodes.size() - 1);
+    }
+    auto node = std::exchange(freeList, nodes[freeList].parent);
+    nodes[node] = Node{};
+    return node;
+}
+
+void AabbTree::freeNode(int node) {
+    nodes[node].parent = std::exchange(freeList, node);
+    nodes[node].height = -1;
+}
+
+void AabbTree::insertLeaf(int leaf) {
+    nodes[leaf].parent = NULL_NODE;
+    if (root == NULL_NODE) {
+        root = leaf;
+        return;
+    }
+    // descend while making the leaf a sibling of a child is cheaper than a
+    // sibling of the current node; the cost is the perimeter of the new
+    // parent plus the growth of all ancestors
+    auto const box = nodes[leaf].box;
+    auto sibling = root;
+    while (!nodes[sibling].isLeaf()) {
+        auto const& node = nodes[sibling];
+        auto perimeter = node.box.perimeter();
+        auto combined = node.box.merged(box).perimeter();
+        auto cost = 2 * combined;
+        auto inheritedCost = 2 * (combined - perimeter);
+        scalar_t childCosts[2];
+        for (int i = 0; i < 2; ++i) {
+            auto const& child = nodes[node.children[i]];
+            childCosts[i] = child.box.merged(box).perimeter() + inheritedCost;
+            if (!child.isLeaf()) {
+                childCosts[i] -= child.box.perimeter();
+            }
+        }
+        if (cost < childCosts[0] && cost < childCosts[1]) {
+            break;
+        }
+        sibling = node.children[childCosts[0] < childCosts[1] ? 0 : 1];
+    }
+
+    auto oldParent = nodes[sibling].parent;
+    auto newParent = allocateNode();
+    nodes[newParent].parent = oldParent;
+    nodes[newParent].children[0] = sibling;
+    nodes[newParent].children[1] = leaf;
+    nodes[sibling].parent = newParent;
+    nodes[leaf].parent = newParent;
+    if (oldParent == NULL_NODE) {
+        root = newParent;
+    } else {
+        auto& children = nodes[oldParent].children;
+        children[children[0] == sibling ? 0 : 1] = newParent;
+    }
+    refitAncestors(leaf);
+}
+
+void AabbTree::removeLeaf(int leaf) {
+    if (leaf == root) {
+        root = NULL_NODE;
+        return;
+    }
+    auto parent = nodes[leaf].parent;
+    auto grandParent = nodes[parent].parent;
+    auto const& children = nodes[parent].children;
+    auto sibling = children[children[0] == leaf ? 1 : 0];
+    nodes[sibling].parent = grandParent;
+    if (grandParent == NULL_NODE) {
+        root = sibling;
+    } else {
+        auto& siblings = nodes[grandParent].children;
+        siblings[siblings[0] == parent ? 0 : 1] = sibling;
+    }
+    freeNode(parent);
+    refitAncestors(sibling);
+}
+
+void AabbTree::refitAncestors(int node) {
+    for (auto index = nodes[node].parent; index != NULL_NODE;
+         index = nodes[index].parent) {
+        refit(index);
+        index = balance(index);
+    }
+}
+
+void AabbTree::refit(int node) {
+    auto& current = nodes[node];
+    auto const& left = nodes[current.children[0]];
+    auto const& right = nodes[current.children[1]];
+    current.box = left.box.merged(right.box);
+    current.height = 1 + std::max(left.height, right.height);
+}
+
+int AabbTree::balance(int a) {
+    if (nodes[a].isLeaf() || nodes[a].height < 2) {
+        return a;
+    }
+    auto const& children = nodes[a].children;
+    auto difference =
+        nodes[children[1]].height - nodes[children[0]].height;
+    if (difference >= -1 && difference <= 1) {
+        return a;
+    }
+    // c takes the place of a, a keeps its shorter child b and gets the
+    // shorter child of c in place of c
+    int side = difference > 1 ? 1 : 0;
+    auto c = nodes[a].children[side];
+    auto f = nodes[c].children[0];
+    auto g = nodes[c].children[1];
+    if (nodes[f].height < nodes[g].height) {
+        std::swap(f, g);
+    }
+    auto parent = nodes[a].parent;
+    nodes[c].parent = parent;
+    if (parent == NULL_NODE) {
+        root = c;
+    } else {
+        auto& siblings = nodes[parent].children;
+        siblings[siblings[0] == a ? 0 : 1] = c;
+    }
+    nodes[c].children[0] = a;
+    nodes[c].children[1] = f;
+    nodes[a].parent = c;
+    nodes[a].children[side] = g;
+    nodes[g].parent = a;
+    refit(a);
+    refit(c);
+    return c;
+}
+}  // namespace ecs
@@ -0,0 +1,176 @@
+#pragma once
+#include "../../Types.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+// axis aligned box, y grows upwards like in the world space
+struct Aabb {
+    scalar_t minX = 0;
+    scalar_t minY = 0;
+    scalar_t maxX = 0;
+    scalar_t maxY = 0;
+
+    // from a bounding box given by its top left corner, width and height
+    static Aabb fromBoundingBox(Vec4 const& boundingBox) noexcept {
+        return {boundingBox[0], boundingBox[1] - boundingBox[3],
+                boundingBox[0] + boundingBox[2], boundingBox[1]};
+    }
+    // false for the bounding box of a collider without active colliders
+    bool isValid() const noexcept { return minX <= maxX && minY <= maxY; }
+    bool overlaps(Aabb const& other) const noexcept {
+        return minX <= other.maxX && other.minX <= maxX &&
+               minY <= other.maxY && other.minY <= maxY;
+    }
+    bool contains(Aabb const& other) const noexcept {
+        return minX <= other.minX && minY <= other.minY &&
+               other.maxX <= maxX && other.maxY <= maxY;
+    }
+    scalar_t perimeter() const noexcept {
+        return 2 * (maxX - minX + maxY - minY);
+    }
+    Aabb merged(Aabb const& other) const noexcept {
+        return {std::min(minX, other.minX), std::min(minY, other.minY),
+                std::max(maxX, other.maxX), std::max(maxY, other.maxY)};
+    }
+    Aabb fattened(scalar_t margin) const noexcept {
+        return {minX - margin, minY - margin, maxX + margin, maxY + margin};
+    }
+};
+
+/*
+Dynamic bounding volume hierarchy. Leaves hold boxes fattened by a margin, so
+a proxy moving a little stays inside its leaf and costs nothing. A proxy that
+leaves its fattened box (or shrinks well inside it) is reinserted: the leaf is
+placed next to the sibling with the smallest perimeter cost and the ancestors
+are refit and rebalanced with tree rotations on the way up.
+*/
+class AabbTree {
+   public:
+    static constexpr int NULL_NODE = -1;
+
+    explicit AabbTree(scalar_t margin) : margin(margin) {}
+    // returns a proxy valid until it is removed
+    int insert(Aabb const& box, uint32_t userData);
+    void remove(int proxy);
+    // returns true if the proxy had to be reinserted
+    bool move(int proxy, Aabb const& box);
+    void clear();
+    uint32_t getUserData(int proxy) const { return nodes[proxy].userData; }
+    void setUserData(int proxy, uint32_t userData) {
+        nodes[proxy].userData = userData;
+    }
+    Aabb const& getFatBox(int proxy) const { return nodes[proxy].box; }
+    size_t size() const noexcept { return leafCount; }
+    // 0 for a single leaf, -1 if empty
+    int getHeight() const noexcept;
+    // calls fn(userData) for every proxy whose fattened box overlaps box
+    template <typename Fn>
+    void query(Aabb const& box, Fn&& fn) const;
+    // calls fn(userDataA, userDataB) once for every pair of proxies whose
+    // fattened boxes overlap, walking down both sides of a pair of subtrees at
+    // once is much cheaper than a query per proxy
+    template <typename Fn>
+    void queryPairs(Fn&& fn);
+
+   private:
+    struct Node {
+        Aabb box;
+        // next free node while on the free list
+        int parent = NULL_NODE;
+        int children[2] = {NULL_NODE, NULL_NODE};
+        int height = 0;
+        uint32_t userData = 0;
+
+        bool isLeaf() const noexcept { return children[0] == NULL_NODE; }
+    };
+
+    int allocateNode();
+    void freeNode(int node);
+    void insertLeaf(int leaf);
+    void removeLeaf(int leaf);
+    // refits the ancestors of node up to the root
+    void refitAncestors(int node);
+    void refit(int node);
+    // rotates the taller child of node up if the children heights differ by
+    // more than one, returns the node now in its place
+    int balance(int node);
+
+    std::vector<Node> nodes;
+    // pairs of subtrees left to visit by queryPairs
+    std::vector<std::pair<int, int>> pairStack;
+    int root = NULL_NODE;
+    int freeList = NULL_NODE;
+    size_t leafCount = 0;
+    scalar_t margin;
+};
+
+template <typename Fn>
+inline void AabbTree::query(Aabb const& box, Fn&& fn) const {
+    // depth first without a stack: after a subtree is done, climb until an
+    // ancestor has an unvisited right child
+    auto node = root;
+    while (node != NULL_NODE) {
+        auto const& current = nodes[node];
+        if (current.box.overlaps(box)) {
+            if (!current.isLeaf()) {
+                node = current.children[0];
+                continue;
+            }
+            fn(current.userData);
+        }
+        while (node != root) {
+            auto parent = nodes[node].parent;
+            if (nodes[parent].children[0] == node) {
+                node = nodes[parent].children[1];
+                break;
+            }
+            node = parent;
+        }
+        if (node == root) {
+            return;
+        }
+    }
+}
+
+template <typename Fn>
+inline void AabbTree::queryPairs(Fn&& fn) {
+    if (root == NULL_NODE) {
+        return;
+    }
+    // a pair of the same node stands for the pairs inside its subtree
+    pairStack.clear();
+    pairStack.emplace_back(root, root);
+    while (!pairStack.empty()) {
+        auto [a, b] = pairStack.back();
+        pairStack.pop_back();
+        auto const& nodeA = nodes[a];
+        auto const& nodeB = nodes[b];
+        if (a == b) {
+            if (!nodeA.isLeaf()) {
+                auto left = nodeA.children[0];
+                auto right = nodeA.children[1];
+                pairStack.emplace_back(left, left);
+                pairStack.emplace_back(right, right);
+                pairStack.emplace_back(left, right);
+            }
+            continue;
+        }
+        if (!nodeA.box.overlaps(nodeB.box)) {
+            continue;
+        }
+        if (nodeA.isLeaf() && nodeB.isLeaf()) {
+            fn(nodeA.userData, nodeB.userData);
+        } else if (nodeB.isLeaf() ||
+                   (!nodeA.isLeaf() &&
+                    nodeA.box.perimeter() >= nodeB.box.perimeter())) {
+            pairStack.emplace_back(nodeA.children[0], b);
+            pairStack.emplace_back(nodeA.children[1], b);
+        } else {
+            pairStack.emplace_back(a, nodeB.children[0]);
+            pairStack.emplace_back(a, nodeB.children[1]);
+        }
+    }
+}
+}  // namespace ecs
@@ -1,6 +1,12 @@
 #include "AiSystem.h"
+#include "../components/Physics2D.h"
+#include "../components/Transform2D.h"
 
 namespace ecs {
+SystemAccess AiSystem::getAccess() {
+    return reads<Transform2D>(writes<Physics2D>());
+}
+
 void AiSystem::addBehavior(std::function<void(float)> behavior) {
     behaviors.emplace_back(behavior);
 }
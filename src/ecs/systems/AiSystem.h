@@ -1,10 +1,15 @@
 #pragma once
+#include "../SystemScheduler.h"
 #include <functional>
 #include <vector>
 
 namespace ecs {
+// behaviors run next to other systems: they may read Transform2D and write
+// Physics2D, structural changes have to be recorded into the engine's
+// CommandBuffer, which is applied after the frame
 class AiSystem {
    public:
+    static SystemAccess getAccess();
     void addBehavior(std::function<void(float)> behavior);
     void update(float dt);
 
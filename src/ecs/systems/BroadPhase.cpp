@@ -0,0 +1,361 @@
+#include "BroadPhase.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace ecs {
+GridBroadPhase::GridBroadPhase(Vec2 worldSize) : worldSize(worldSize) {
+    cellSize[0] = worldSize[0] / 100.f;
+    cellSize[1] = worldSize[1] / 100.f;
+    totalCols = worldSize[0] / cellSize[0];
+    totalRows = worldSize[1] / cellSize[1];
+}
+
+void GridBroadPhase::findPairs(std::span<Vec4 const> boxes, PairBuffer& out) {
+    detections.clear();
+    out.clear();
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        addDetectionData(static_cast<uint32_t>(i), boxes[i]);
+    }
+    std::sort(detections.begin(), detections.end(),
+              [](DetectionData const& l, DetectionData const& r) {
+                  return l.gridCellIndex < r.gridCellIndex;
+              });
+
+    for (int i = 1; i < detections.size(); ++i) {
+        auto d = detections[i - 1];
+        if (d.gridCellIndex == detections[i].gridCellIndex) {
+            for (int j = i; j < detections.size(); ++j) {
+                if (detections[j].gridCellIndex != d.gridCellIndex) {
+                    break;
+                }
+                // bodies sharing several cells are added once per cell
+                out.add(d.body, detections[j].body);
+            }
+        }
+    }
+    out.finalize();
+}
+
+void GridBroadPhase::addDetectionData(uint32_t body, Vec4 const& boundingBox) {
+    /*
+    Maps world coordinates to grid cells. Entities inside the same cells are
+    potentially colliding. grid(0,0) <=> world(-worldSizeX/2, worldSizeY/2)
+    grid(n,n) <=> world(worldSizeX/2, -worldSizeY/2)
+    */
+    auto halfWorldW = worldSize[0] / 2;
+    auto halfWorldH = worldSize[1] / 2;
+    if (boundingBox[0] < -halfWorldW || boundingBox[1] < -halfWorldH ||
+        boundingBox[0] > halfWorldW || boundingBox[1] > halfWorldH) {
+        return;
+    }
+
+    auto leftWorldBoundry = -halfWorldW;
+    auto topWorldBoundry = halfWorldH;
+    int topLeftCol = static_cast<int>(
+        std::abs(boundingBox[0] - leftWorldBoundry) / cellSize[0]);
+    int topLeftRow = static_cast<int>(
+        std::abs(boundingBox[1] - topWorldBoundry) / cellSize[1]);
+    int botRightCol = static_cast<int>(
+        std::abs(boundingBox[0] + boundingBox[2] - leftWorldBoundry) /
+        cellSize[0]);
+    int botRightRow = static_cast<int>(
+        std::abs(boundingBox[1] - boundingBox[3] - topWorldBoundry) /
+        cellSize[1]);
+
+    int width = botRightCol - topLeftCol + 1;
+    int height = botRightRow - topLeftRow + 1;
+
+    // add all cells if an object occupies more than one
+    for (int i = topLeftRow; i < topLeftRow + height; ++i) {
+        for (int j = topLeftCol; j < topLeftCol + width; ++j) {
+            int cellIndex = i * totalCols + j;
+            detections.push_back({body, cellIndex});
+        }
+    }
+}
+
+void TreeBroadPhase::findPairs(std::span<Entity const> bodies,
+                               std::span<Vec4 const> boxes, PairBuffer& out) {
+    ++frame;
+    out.clear();
+    tightBoxes.resize(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        auto const& box = tightBoxes[i] = Aabb::fromBoundingBox(boxes[i]);
+        if (!box.isValid()) {
+            continue;
+        }
+        auto const& entity = bodies[i];
+        if (entity.getId() >= proxies.size()) {
+            proxies.resize(entity.getId() + 1);
+        }
+        auto& proxy = proxies[entity.getId()];
+        // the id was reused by another entity since the last frame
+        if (proxy.node != AabbTree::NULL_NODE && proxy.entity != entity) {
+            tree.remove(proxy.node);
+            proxy.node = AabbTree::NULL_NODE;
+        }
+        if (proxy.node == AabbTree::NULL_NODE) {
+            proxy.node = tree.insert(box, static_cast<uint32_t>(i));
+            proxy.entity = entity;
+        } else {
+            tree.move(proxy.node, box);
+            tree.setUserData(proxy.node, static_cast<uint32_t>(i));
+        }
+        proxy.frame = frame;
+    }
+    for (auto& proxy : proxies) {
+        if (proxy.node != AabbTree::NULL_NODE && proxy.frame != frame) {
+            tree.remove(proxy.node);
+            proxy.node = AabbTree::NULL_NODE;
+        }
+    }
+
+    // fattened boxes are only good for finding candidates, pairs whose
+    // actual boxes do not overlap are dropped
+    tree.queryPairs([&](uint32_t a, uint32_t b) {
+        if (tightBoxes[a].overlaps(tightBoxes[b])) {
+            out.add(a, b);
+        }
+    });
+    out.finalize();
+}
+
+void TreeBroadPhase::clear() {
+    tree.clear();
+    proxies.clear();
+}
+
+namespace {
+scalar_t getEndpointValue(Aabb const& box, size_t axis, bool isMax) {
+    if (axis == 0) {
+        return isMax ? box.maxX : box.minX;
+    }
+    return isMax ? box.maxY : box.minY;
+}
+
+// erases value from an unordered vector
+void eraseUnordered(std::vector<uint32_t>& values, uint32_t value) {
+    auto it = std::find(values.begin(), values.end(), value);
+    *it = values.back();
+    values.pop_back();
+}
+}  // namespace
+
+void SweepAndPruneBroadPhase::findPairs(std::span<Entity const> bodies,
+                                        std::span<Vec4 const> boxes,
+                                        PairBuffer& out) {
+    ++frame;
+    added.clear();
+    removed.clear();
+    updateProxies(bodies, boxes);
+    for (size_t axis = 0; axis < axes.size(); ++axis) {
+        for (auto& endpoint : axes[axis]) {
+            endpoint.value = getEndpointValue(proxies[endpoint.proxy].box,
+                                              axis, endpoint.isMax);
+        }
+        sortAxis(axes[axis]);
+    }
+    insertNewProxies();
+    updatePairs();
+
+    out.clear();
+    for (auto key : pairs) {
+        auto [a, b] = PairBuffer::unpack(key);
+        out.add(proxies[a].body, proxies[b].body);
+    }
+    out.finalize();
+}
+
+void SweepAndPruneBroadPhase::clear() {
+    proxies.clear();
+    for (auto& endpoints : axes) {
+        endpoints.clear();
+    }
+    touched.clear();
+    pairs.clear();
+    added.clear();
+    removed.clear();
+}
+
+void SweepAndPruneBroadPhase::updateProxies(std::span<Entity const> bodies,
+                                            std::span<Vec4 const> boxes) {
+    // proxies of destroyed entities, of reused ids and of bodies without an
+    // active collider are removed before the others are inserted
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        auto id = bodies[i].getId();
+        if (id < proxies.size() && proxies[id].inserted &&
+            proxies[id].entity == bodies[i] &&
+            Aabb::fromBoundingBox(boxes[i]).isValid()) {
+            proxies[id].frame = frame;
+        }
+    }
+    bool stale = false;
+    for (auto& proxy : proxies) {
+        if (proxy.inserted && proxy.frame != frame) {
+            proxy.inserted = false;
+            stale = true;
+        }
+    }
+    if (stale) {
+        removeProxies();
+    }
+
+    for (size_t i = 0; i < boxes.size(); ++i) {
+        auto box = Aabb::fromBoundingBox(boxes[i]);
+        if (!box.isValid()) {
+            continue;
+        }
+        auto id = bodies[i].getId();
+        if (id > std::numeric_limits<uint32_t>::max()) {
+            throw std::runtime_error(
+                "Sweep and prune supports entity ids up to 32 bits");
+        }
+        if (id >= proxies.size()) {
+            proxies.resize(id + 1);
+        }
+        auto& proxy = proxies[id];
+        proxy.entity = bodies[i];
+        proxy.box = box;
+        proxy.body = static_cast<uint32_t>(i);
+        if (!proxy.inserted) {
+            proxy.inserted = true;
+            proxy.isNew = true;
+            proxy.frame = frame;
+            newProxies.emplace_back(static_cast<uint32_t>(id));
+        }
+    }
+}
+
+void SweepAndPruneBroadPhase::removeProxies() {
+    for (auto& endpoints : axes) {
+        std::erase_if(endpoints, [&](Endpoint const& endpoint) {
+            return !proxies[endpoint.proxy].inserted;
+        });
+    }
+    size_t kept = 0;
+    for (auto key : pairs) {
+        auto [a, b] = PairBuffer::unpack(key);
+        if (proxies[a].inserted && proxies[b].inserted) {
+            pairs[kept++] = key;
+        } else {
+            removed.emplace_back(proxies[a].entity, proxies[b].entity);
+        }
+    }
+    pairs.resize(kept);
+}
+
+void SweepAndPruneBroadPhase::sortAxis(std::vector<Endpoint>& endpoints) {
+    // the overlap of two intervals on this axis changes exactly when a min
+    // endpoint of one passes the max endpoint of the other
+    for (size_t i = 1; i < endpoints.size(); ++i) {
+        auto endpoint = endpoints[i];
+        auto j = i;
+        for (; j > 0 && precedes(endpoint, endpoints[j - 1]); --j) {
+            auto const& passed = endpoints[j - 1];
+            if (passed.isMax != endpoint.isMax &&
+                passed.proxy != endpoint.proxy) {
+                touched.add(passed.proxy, endpoint.proxy);
+            }
+            endpoints[j] = passed;
+        }
+        endpoints[j] = endpoint;
+    }
+}
+
+void SweepAndPruneBroadPhase::insertNewProxies() {
+    if (newProxies.empty()) {
+        return;
+    }
+    for (size_t axis = 0; axis < axes.size(); ++axis) {
+        auto& endpoints = newEndpoints[axis];
+        endpoints.clear();
+        for (auto id : newProxies) {
+            auto const& box = proxies[id].box;
+            endpoints.push_back({getEndpointValue(box, axis, false), id, false});
+            endpoints.push_back({getEndpointValue(box, axis, true), id, true});
+        }
+        std::sort(endpoints.begin(), endpoints.end(), precedes);
+        merged.clear();
+        std::merge(axes[axis].begin(), axes[axis].end(), endpoints.begin(),
+                   endpoints.end(), std::back_inserter(merged), precedes);
+        std::swap(axes[axis], merged);
+    }
+
+    // one sweep along x marks every pair overlapping on x with a new proxy
+    active.clear();
+    activeNew.clear();
+    for (auto const& endpoint : axes[0]) {
+        bool isNew = proxies[endpoint.proxy].isNew;
+        if (endpoint.isMax) {
+            eraseUnordered(active, endpoint.proxy);
+            if (isNew) {
+                eraseUnordered(activeNew, endpoint.proxy);
+            }
+            continue;
+        }
+        for (auto other : isNew ? active : activeNew) {
+            touched.add(endpoint.proxy, other);
+        }
+        active.emplace_back(endpoint.proxy);
+        if (isNew) {
+            activeNew.emplace_back(endpoint.proxy);
+        }
+    }
+    for (auto id : newProxies) {
+        proxies[id].isNew = false;
+    }
+    newProxies.clear();
+}
+
+void SweepAndPruneBroadPhase::updatePairs() {
+    // both lists are sorted, untouched pairs are copied over
+    touched.finalize();
+    updatedPairs.clear();
+    size_t p = 0;
+    for (auto key : touched.getKeys()) {
+        while (p < pairs.size() && pairs[p] < key) {
+            updatedPairs.emplace_back(pairs[p++]);
+        }
+        bool present = p < pairs.size() && pairs[p] == key;
+        if (present) {
+            ++p;
+        }
+        auto [a, b] = PairBuffer::unpack(key);
+        auto const& proxyA = proxies[a];
+        auto const& proxyB = proxies[b];
+        if (proxyA.box.overlaps(proxyB.box)) {
+            updatedPairs.emplace_back(key);
+            if (!present) {
+                added.emplace_back(proxyA.entity, proxyB.entity);
+            }
+        } else if (present) {
+            removed.emplace_back(proxyA.entity, proxyB.entity);
+        }
+    }
+    updatedPairs.insert(updatedPairs.end(), pairs.begin() + p, pairs.end());
+    std::swap(pairs, updatedPairs);
+    touched.clear();
+}
+
+void StaticBroadPhase::findPairs(std::span<Vec4 const> dynamicBoxes,
+                                 PairBuffer& out) {
+    for (auto& proxy : proxies) {
+        if (proxy.node != AabbTree::NULL_NODE && proxy.frame != frame) {
+            tree.remove(proxy.node);
+            proxy.node = AabbTree::NULL_NODE;
+        }
+    }
+    auto firstStatic = static_cast<uint32_t>(dynamicBoxes.size());
+    for (size_t i = 0; i < dynamicBoxes.size(); ++i) {
+        auto box = Aabb::fromBoundingBox(dynamicBoxes[i]);
+        if (!box.isValid()) {
+            continue;
+        }
+        auto body = static_cast<uint32_t>(i);
+        tree.query(box, [&](uint32_t staticBody) {
+            out.add(body, firstStatic + staticBody);
+        });
+    }
+}
+}  // namespace ecs
@@ -0,0 +1,205 @@
+#pragma once
+#include "../EcsContainer.h"
+#include "AabbTree.h"
+#include "PairBuffer.h"
+#include <array>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+/*
+Broadphases find the pairs of bodies whose bounding boxes may overlap. Body i
+of a frame owns boxes[i], given as the top left corner, width and height like
+Collider2D::getBoundingBox(). Pairs of body indices are written to a
+PairBuffer, sorted and without duplicates; a pair may not overlap after all.
+*/
+enum class BroadPhaseType { GRID, AABB_TREE, SWEEP_AND_PRUNE };
+
+struct DetectionData {
+    uint32_t body;
+    int gridCellIndex;
+};
+
+// fixed grid of 100 x 100 cells centered at the origin, boxes whose top left
+// corner is outside of the world are ignored
+class GridBroadPhase {
+   public:
+    explicit GridBroadPhase(Vec2 worldSize);
+    void findPairs(std::span<Vec4 const> boxes, PairBuffer& out);
+
+   private:
+    void addDetectionData(uint32_t body, Vec4 const& boundingBox);
+
+    std::vector<DetectionData> detections;
+    Vec2 worldSize;
+    Vec2 cellSize;
+    scalar_t totalRows;
+    scalar_t totalCols;
+};
+
+// keeps a proxy in an AabbTree for every entity across frames, bodies are
+// told apart by their entities
+class TreeBroadPhase {
+   public:
+    static constexpr scalar_t DEFAULT_MARGIN = 0.1f;
+
+    explicit TreeBroadPhase(scalar_t margin = DEFAULT_MARGIN)
+        : tree(margin) {}
+    void findPairs(std::span<Entity const> bodies, std::span<Vec4 const> boxes,
+                   PairBuffer& out);
+    void clear();
+    AabbTree const& getTree() const noexcept { return tree; }
+
+   private:
+    struct Proxy {
+        Entity entity;
+        int node = AabbTree::NULL_NODE;
+        uint32_t frame = 0;
+    };
+
+    AabbTree tree;
+    // indexed by entity id
+    std::vector<Proxy> proxies;
+    std::vector<Aabb> tightBoxes;
+    uint32_t frame = 0;
+};
+
+/*
+Incremental sweep and prune. The box endpoints on both axes stay sorted across
+frames and are resorted with an insertion sort, which is close to linear when
+bodies move little. An endpoint moving past an endpoint of another body marks
+the pair, only marked pairs are tested again. Overlapping pairs are kept by
+entity id, the pairs that started and stopped overlapping are reported after
+each frame. New bodies are sorted in with a single sweep.
+*/
+class SweepAndPruneBroadPhase {
+   public:
+    using EntityPair = std::pair<Entity, Entity>;
+
+    void findPairs(std::span<Entity const> bodies, std::span<Vec4 const> boxes,
+                   PairBuffer& out);
+    void clear();
+    // pairs that started overlapping in the last findPairs
+    std::span<EntityPair const> getAddedPairs() const noexcept {
+        return added;
+    }
+    // pairs that stopped overlapping or lost a body in the last findPairs
+    std::span<EntityPair const> getRemovedPairs() const noexcept {
+        return removed;
+    }
+
+   private:
+    struct Endpoint {
+        scalar_t value;
+        uint32_t proxy;  // entity id
+        bool isMax;
+    };
+    struct Proxy {
+        Entity entity;
+        Aabb box;
+        uint32_t body = 0;
+        uint32_t frame = 0;
+        bool inserted = false;
+        bool isNew = false;
+    };
+
+    // min endpoints first on equal values, touching boxes overlap
+    static bool precedes(Endpoint const& l, Endpoint const& r) noexcept {
+        return l.value < r.value || (l.value == r.value && !l.isMax && r.isMax);
+    }
+    void updateProxies(std::span<Entity const> bodies,
+                       std::span<Vec4 const> boxes);
+    // removes the endpoints and pairs of proxies that are not inserted
+    void removeProxies();
+    void sortAxis(std::vector<Endpoint>& endpoints);
+    void insertNewProxies();
+    void updatePairs();
+
+    // indexed by entity id
+    std::vector<Proxy> proxies;
+    std::array<std::vector<Endpoint>, 2> axes;
+    std::array<std::vector<Endpoint>, 2> newEndpoints;
+    std::vector<Endpoint> merged;
+    std::vector<uint32_t> newProxies;
+    // proxies whose min endpoint was passed by the sweep and max was not
+    std::vector<uint32_t> active;
+    std::vector<uint32_t> activeNew;
+    // pairs of entity ids whose boxes may have started or stopped overlapping
+    PairBuffer touched;
+    // sorted pairs of entity ids
+    std::vector<uint64_t> pairs;
+    std::vector<uint64_t> updatedPairs;
+    std::vector<EntityPair> added;
+    std::vector<EntityPair> removed;
+    uint32_t frame = 0;
+};
+
+/*
+Bodies that do not move, kept in an AabbTree across frames. Every frame each
+static body is added again, its bounding box is only computed if it is new or
+changed. Static bodies are paired with the moving ones only, never with each
+other.
+*/
+class StaticBroadPhase {
+   public:
+    void beginFrame() {
+        ++frame;
+        bodies.clear();
+        refreshed = 0;
+    }
+    // boundingBox() is called only for a new or changed body
+    template <typename BoxFn>
+    void addBody(Entity const& entity, bool changed, BoxFn&& boundingBox);
+    // drops the bodies not added since beginFrame and adds the pairs of a
+    // moving body i owning dynamicBoxes[i] and static body k to out as
+    // (i, dynamicBoxes.size() + k), out has to be finalized afterwards
+    void findPairs(std::span<Vec4 const> dynamicBoxes, PairBuffer& out);
+    // static body k of this frame
+    std::span<Entity const> getBodies() const noexcept { return bodies; }
+    // bounding boxes computed in this frame
+    size_t getRefreshedCount() const noexcept { return refreshed; }
+
+   private:
+    struct Proxy {
+        Entity entity;
+        int node = AabbTree::NULL_NODE;
+        uint32_t frame = 0;
+    };
+
+    // static boxes are exact
+    AabbTree tree{0};
+    // indexed by entity id
+    std::vector<Proxy> proxies;
+    std::vector<Entity> bodies;
+    uint32_t frame = 0;
+    size_t refreshed = 0;
+};
+
+template <typename BoxFn>
+inline void StaticBroadPhase::addBody(Entity const& entity, bool changed,
+                                      BoxFn&& boundingBox) {
+    if (entity.getId() >= proxies.size()) {
+        proxies.resize(entity.getId() + 1);
+    }
+    auto& proxy = proxies[entity.getId()];
+    auto body = static_cast<uint32_t>(bodies.size());
+    bodies.emplace_back(entity);
+    proxy.frame = frame;
+    if (proxy.node != AabbTree::NULL_NODE && !changed &&
+        proxy.entity == entity) {
+        tree.setUserData(proxy.node, body);
+        return;
+    }
+    if (proxy.node != AabbTree::NULL_NODE) {
+        tree.remove(proxy.node);
+        proxy.node = AabbTree::NULL_NODE;
+    }
+    ++refreshed;
+    proxy.entity = entity;
+    auto box = Aabb::fromBoundingBox(boundingBox());
+    if (box.isValid()) {
+        proxy.node = tree.insert(box, body);
+    }
+}
+}  // namespace ecs
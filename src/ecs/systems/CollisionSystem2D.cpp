@@ -2,132 +2,151 @@
 #include "../components/Collider2D.h"
 #include "../components/Physics2D.h"
 #include "../components/Transform2D.h"
+#include <algorithm>
+#include <tuple>
+#include <utility>
 
 namespace ecs {
 
-CollisionSystem2D::CollisionSystem2D(Vec2 worldSize) : worldSize(worldSize) {
-    cellSize[0] = worldSize[0] / 100.f;
-    cellSize[1] = worldSize[1] / 100.f;
-    totalCols = worldSize[0] / cellSize[0];
-    totalRows = worldSize[1] / cellSize[1];
+SystemAccess CollisionSystem2D::getAccess() {
+    return writes<Transform2D, Physics2D, Collider2D>();
+}
+
+CollisionSystem2D::CollisionSystem2D(Vec2 worldSize,
+                                     BroadPhaseType broadPhase)
+    : broadPhaseType(broadPhase), grid(worldSize) {}
+
+void CollisionSystem2D::setBroadPhase(BroadPhaseType type) {
+    if (type != broadPhaseType) {
+        tree.clear();
+        sweepAndPrune.clear();
+        broadPhaseType = type;
+    }
 }
 
 void CollisionSystem2D::broadPhase(ecs::EcsContainer& ecsContainer) {
-    detections.clear();
-    potentialCollisions.clear();
-    for (auto& colliders : ecs::ForEachComponent<Collider2D>(ecsContainer)) {
-        addDetectionData(colliders.getEntity(), colliders.getBoundingBox());
-    }
-    std::sort(detections.begin(), detections.end(),
-              [](DetectionData const& l, DetectionData const& r) {
-                  return l.gridCellIndex < r.gridCellIndex;
-              });
-
-    for (int i = 1; i < detections.size(); ++i) {
-        auto d = detections[i - 1];
-        if (d.gridCellIndex == detections[i].gridCellIndex) {
-            for (int j = i; j < detections.size(); ++j) {
-                if (detections[j].gridCellIndex != d.gridCellIndex) {
-                    break;
-                }
-                auto idA = d.entity;
-                auto idB = detections[j].entity;
-                potentialCollisions.insert({idA, idB});
-            }
+    auto since = std::exchange(lastRun, advanceTick());
+    bodies.clear();
+    bodyColliders.clear();
+    staticColliders.clear();
+    boxes.clear();
+    staticWorld.beginFrame();
+    for (auto [collider, transform, physics] :
+         ecsContainer.getEntitiesWithComponents<
+             Collider2D, Optional<Transform2D>, Optional<Physics2D>>()) {
+        if (transform && physics && physics->isStatic()) {
+            bool changed = transform->changedSince(since) ||
+                           collider->changedSince(since);
+            staticWorld.addBody(collider->getEntity(), changed, [&] {
+                // the hierarchy may have moved it after the physics system
+                // updated the colliders
+                collider->update(transform->modelToWorld(),
+                                 transform->normalsRotation(),
+                                 transform->getWorldScaleFactor());
+                return collider->getBoundingBox();
+            });
+            staticColliders.emplace_back(collider);
+            continue;
         }
+        bodies.emplace_back(collider->getEntity());
+        bodyColliders.emplace_back(collider);
+        boxes.emplace_back(collider->getBoundingBox());
+    }
+    switch (broadPhaseType) {
+        case BroadPhaseType::GRID:
+            grid.findPairs(boxes, potentialCollisions);
+            break;
+        case BroadPhaseType::AABB_TREE:
+            tree.findPairs(bodies, boxes, potentialCollisions);
+            break;
+        case BroadPhaseType::SWEEP_AND_PRUNE:
+            sweepAndPrune.findPairs(bodies, boxes, potentialCollisions);
+            break;
     }
+    // static bodies follow the moving ones
+    staticWorld.findPairs(boxes, potentialCollisions);
+    potentialCollisions.finalize();
+    auto staticBodies = staticWorld.getBodies();
+    bodies.insert(bodies.end(), staticBodies.begin(), staticBodies.end());
+    bodyColliders.insert(bodyColliders.end(), staticColliders.begin(),
+                         staticColliders.end());
 }
 
-void CollisionSystem2D::addDetectionData(Entity const& entity,
-                                         Vec4 const& boundingBox) {
-    /*
-    Maps world coordinates to grid cells. Entities inside the same cells are
-    potentially colliding. grid(0,0) <=> world(-worldSizeX/2, worldSizeY/2)
-    grid(n,n) <=> world(worldSizeX/2, -worldSizeY/2)
-    */
-    auto halfWorldW = worldSize[0] / 2;
-    auto halfWorldH = worldSize[1] / 2;
-    if (boundingBox[0] < -halfWorldW || boundingBox[1] < -halfWorldH ||
-        boundingBox[0] > halfWorldW || boundingBox[1] > halfWorldH) {
-        return;
+void CollisionSystem2D::checkCollisions(ecs::EcsContainer& ecsContainer,
+                                        EventBus& events, scalar_t dt) {
+    broadPhase(ecsContainer);
+    auto pairCount = potentialCollisions.size();
+    auto rangeCount =
+        (pairCount + NARROW_PHASE_GRAIN - 1) / NARROW_PHASE_GRAIN;
+    if (hitRanges.size() < rangeCount) {
+        hitRanges.resize(rangeCount);
     }
-
-    auto leftWorldBoundry = -halfWorldW;
-    auto topWorldBoundry = halfWorldH;
-    int topLeftCol = static_cast<int>(
-        std::abs(boundingBox[0] - leftWorldBoundry) / cellSize[0]);
-    int topLeftRow = static_cast<int>(
-        std::abs(boundingBox[1] - topWorldBoundry) / cellSize[1]);
-    int botRightCol = static_cast<int>(
-        std::abs(boundingBox[0] + boundingBox[2] - leftWorldBoundry) /
-        cellSize[0]);
-    int botRightRow = static_cast<int>(
-        std::abs(boundingBox[1] - boundingBox[3] - topWorldBoundry) /
-        cellSize[1]);
-
-    int width = botRightCol - topLeftCol + 1;
-    int height = botRightRow - topLeftRow + 1;
-
-    // add all cells if an object occupies more than one
-    for (int i = topLeftRow; i < topLeftRow + height; ++i) {
-        for (int j = topLeftCol; j < topLeftCol + width; ++j) {
-            int cellIndex = i * totalCols + j;
-            detections.push_back({entity, cellIndex});
+    // ranges start at multiples of the grain, each one owns a buffer
+    auto testPairs = [&](size_t begin, size_t end) {
+        auto& hits = hitRanges[begin / NARROW_PHASE_GRAIN];
+        hits.clear();
+        narrowPhase(begin, end, hits);
+    };
+    if (threadPool) {
+        threadPool->parallelFor(pairCount, NARROW_PHASE_GRAIN, testPairs);
+    } else {
+        for (size_t begin = 0; begin < pairCount;
+             begin += NARROW_PHASE_GRAIN) {
+            testPairs(begin, std::min(begin + NARROW_PHASE_GRAIN, pairCount));
+        }
+    }
+    // resolving depends on the order (grounded flags, hitbox targets), the
+    // ranges are taken in pair order like in a serial run
+    for (size_t range = 0; range < rangeCount; ++range) {
+        for (auto const& hit : hitRanges[range]) {
+            resolveCollision(ecsContainer, events,
+                             CollisionData(*hit.cA, *hit.cB, hit.a, hit.b,
+                                           hit.indexA, hit.indexB, hit.mtv),
+                             dt);
         }
     }
+    sendContactEvents(events);
+    resolveAllCollisions(ecsContainer, dt);
 }
 
-void CollisionSystem2D::checkCollisions(ecs::EcsContainer& ecsContainer,
-                                        scalar_t dt) {
+// only reads the world space data of the colliders, safe to run in parallel
+void CollisionSystem2D::narrowPhase(size_t begin, size_t end,
+                                    std::vector<NarrowPhaseHit>& hits) const {
     MinimumTranslation mtv;
-
-    broadPhase(ecsContainer);
-    for (auto const& pc : potentialCollisions) {
-        auto idA = pc.first;
-        auto idB = pc.second;
-        auto const& collidersA =
-            ecsContainer.getComponent<Collider2D>(idA)->getColliders();
-        auto const& collidersB =
-            ecsContainer.getComponent<Collider2D>(idB)->getColliders();
-        for (auto const& cA : collidersA) {
+    for (auto i = begin; i < end; ++i) {
+        auto [bodyA, bodyB] = potentialCollisions[i];
+        auto idA = bodies[bodyA];
+        auto idB = bodies[bodyB];
+        auto const& collidersA = bodyColliders[bodyA]->getColliders();
+        auto const& collidersB = bodyColliders[bodyB]->getColliders();
+        for (int iA = 0; iA < collidersA.size(); ++iA) {
+            auto const& cA = collidersA[iA];
             if (!cA->isActive()) continue;
             auto shape1 = cA->getShape();
-            for (auto const& cB : collidersB) {
+            for (int iB = 0; iB < collidersB.size(); ++iB) {
+                auto const& cB = collidersB[iB];
                 if (!cB->isActive()) continue;
                 auto shape2 = cB->getShape();
                 if (shape1 == Shape::POLYGON) {
-                    if (shape2 == Shape::POLYGON) {
-                        if (polygonPolygon(*cA, *cB, mtv)) {
-                            resolveCollision(
-                                ecsContainer,
-                                CollisionData(*cA, *cB, idA, idB, mtv), dt);
-                        }
-                    } else {
-                        if (polygonCircle(*cA, *cB, mtv)) {
-                            resolveCollision(
-                                ecsContainer,
-                                CollisionData(*cA, *cB, idA, idB, mtv), dt);
-                        }
+                    bool hit = shape2 == Shape::POLYGON
+                                   ? polygonPolygon(*cA, *cB, mtv)
+                                   : polygonCircle(*cA, *cB, mtv);
+                    if (hit) {
+                        hits.push_back(
+                            {cA.get(), cB.get(), idA, idB, iA, iB, mtv});
                     }
-                } else {
-                    if (shape2 == Shape::POLYGON) {
-                        if (polygonCircle(*cB, *cA, mtv)) {
-                            resolveCollision(
-                                ecsContainer,
-                                CollisionData(*cB, *cA, idB, idA, mtv), dt);
-                        }
-                    } else {
-                        if (circleCircle(*cA, *cB, mtv)) {
-                            resolveCollision(
-                                ecsContainer,
-                                CollisionData(*cA, *cB, idA, idB, mtv), dt);
-                        }
+                } else if (shape2 == Shape::POLYGON) {
+                    // the polygon comes first
+                    if (polygonCircle(*cB, *cA, mtv)) {
+                        hits.push_back(
+                            {cB.get(), cA.get(), idB, idA, iB, iA, mtv});
                     }
+                } else if (circleCircle(*cA, *cB, mtv)) {
+                    hits.push_back({cA.get(), cB.get(), idA, idB, iA, iB, mtv});
                 }
             }
         }
     }
-    resolveAllCollisions(ecsContainer, dt);
 }
 
 bool CollisionSystem2D::areColliding(ecs::EcsContainer& ecsContainer, Entity a,
@@ -361,6 +380,7 @@ void CollisionSystem2D::findMinMaxProjectionCircle(Vec4 const& center,
 }
 
 void CollisionSystem2D::resolveCollision(ecs::EcsContainer& ecsContainer,
+                                         EventBus& events,
                                          CollisionData const& collision,
                                          scalar_t dt) {
     auto* ca = ecsContainer.getComponent<Collider2D>(collision.a);
@@ -368,7 +388,9 @@ void CollisionSystem2D::resolveCollision(ecs::EcsContainer& ecsContainer,
     if (collision.cA.getType() == ColliderType::HITBOX) {
         if (collision.cB.getType() == ColliderType::PHYSICS) {
             if (ca->setCurrentHitboxTarget(collision.b)) {
-                collision.cA.notifyHitbox(ecsContainer, collision.b);
+                events.send(
+                    HitboxHit{collision.a, collision.b, collision.indexA,
+                              collision.cA.getDamage()});
             }
         }
         return;
@@ -377,11 +399,14 @@ void CollisionSystem2D::resolveCollision(ecs::EcsContainer& ecsContainer,
     if (collision.cB.getType() == ColliderType::HITBOX) {
         if (collision.cA.getType() == ColliderType::PHYSICS) {
             if (cb->setCurrentHitboxTarget(collision.a)) {
-                collision.cB.notifyHitbox(ecsContainer, collision.a);
+                events.send(
+                    HitboxHit{collision.b, collision.a, collision.indexB,
+                              collision.cB.getDamage()});
             }
         }
         return;
     }
+    addContact(collision);
 
     auto* pa = ecsContainer.getComponent<Physics2D>(collision.a);
     auto* pb = ecsContainer.getComponent<Physics2D>(collision.b);
@@ -389,11 +414,6 @@ void CollisionSystem2D::resolveCollision(ecs::EcsContainer& ecsContainer,
         return;
     }
 
-    if (!(pa->isStatic() && pb->isStatic())) {
-        collision.cA.notifyHitbox(ecsContainer, collision.b);
-        collision.cB.notifyHitbox(ecsContainer, collision.a);
-    }
-
     forces.resize(ecsContainer.getMaximumEntityCount());
 
     auto* ta = ecsContainer.getComponent<Transform2D>(collision.a);
@@ -466,6 +486,60 @@ void CollisionSystem2D::resolveCollision(ecs::EcsContainer& ecsContainer,
     }
 }
 
+namespace {
+auto contactKey(CollisionBegan const& contact) {
+    return std::tuple(contact.a.getHandle(), contact.b.getHandle(),
+                      contact.colliderA, contact.colliderB);
+}
+
+bool contactLess(CollisionBegan const& l, CollisionBegan const& r) {
+    return contactKey(l) < contactKey(r);
+}
+}  // namespace
+
+void CollisionSystem2D::addContact(CollisionData const& collision) {
+    CollisionBegan contact{collision.a,          collision.b,
+                           collision.indexA,     collision.indexB,
+                           collision.mtv.normal, collision.cA.getDamage(),
+                           collision.cB.getDamage()};
+    // the same pair is reported in either order
+    if (contact.b.getHandle() < contact.a.getHandle()) {
+        std::swap(contact.a, contact.b);
+        std::swap(contact.colliderA, contact.colliderB);
+        std::swap(contact.damageA, contact.damageB);
+        contact.normal = -contact.normal;
+    }
+    contacts.emplace_back(contact);
+}
+
+void CollisionSystem2D::sendContactEvents(EventBus& events) {
+    std::sort(contacts.begin(), contacts.end(), contactLess);
+    auto& began = events.get<CollisionBegan>();
+    auto& ended = events.get<CollisionEnded>();
+    auto end = [&](CollisionBegan const& contact) {
+        ended.send(CollisionEnded{contact.a, contact.b, contact.colliderA,
+                                  contact.colliderB});
+    };
+    auto previous = previousContacts.begin();
+    for (auto const& contact : contacts) {
+        while (previous != previousContacts.end() &&
+               contactLess(*previous, contact)) {
+            end(*previous++);
+        }
+        if (previous == previousContacts.end() ||
+            contactLess(contact, *previous)) {
+            began.send(contact);
+        } else {
+            ++previous;
+        }
+    }
+    for (; previous != previousContacts.end(); ++previous) {
+        end(*previous);
+    }
+    std::swap(contacts, previousContacts);
+    contacts.clear();
+}
+
 void CollisionSystem2D::renderBoundingBoxes(ecs::EcsContainer& ecsContainer,
                                             Renderer& renderer,
                                             Shader const& shader) {
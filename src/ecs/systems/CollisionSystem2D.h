@@ -1,7 +1,10 @@
 #pragma once
 #include "../components/Collider2D.h"
 #include "Renderer.h"
-#include <set>
+#include "../EventBus.h"
+#include "BroadPhase.h"
+#include "../SystemScheduler.h"
+#include "../../ThreadPool.h"
 
 class Transform2D;
 class Physics2D;
@@ -12,21 +15,51 @@ struct MinimumTranslation {
     scalar_t magnitude = 0;
 };
 
+// physics colliders of two entities started touching, normal points from b
+// to a
+struct CollisionBegan {
+    Entity a;
+    Entity b;
+    int colliderA = 0;
+    int colliderB = 0;
+    Vec2 normal;
+    // of the colliders, readers need no Collider2D access
+    DamageRange damageA;
+    DamageRange damageB;
+};
+
+// physics colliders of two entities stopped touching, either entity may have
+// been removed
+struct CollisionEnded {
+    Entity a;
+    Entity b;
+    int colliderA = 0;
+    int colliderB = 0;
+};
+
+// a hitbox collider of source overlapped target, sent once per target until
+// the hitbox targets of source are cleared
+struct HitboxHit {
+    Entity source;
+    Entity target;
+    int collider = 0;
+    DamageRange damage;
+};
+
 struct CollisionData {
     CollisionData(BaseCollider2D const& cA, BaseCollider2D const& cB,
-                  Entity const& a, Entity const& b,
+                  Entity const& a, Entity const& b, int indexA, int indexB,
                   MinimumTranslation const& mtv)
-        : cA(cA), cB(cB), a(a), b(b), mtv(mtv) {}
+        : cA(cA), cB(cB), a(a), b(b), indexA(indexA), indexB(indexB),
+          mtv(mtv) {}
     BaseCollider2D const& cA;
     BaseCollider2D const& cB;
     Entity a;
     Entity b;
+    int indexA;  // of the colliders in Collider2D
+    int indexB;
     MinimumTranslation mtv;
 };
-struct DetectionData {
-    Entity entity;
-    int gridCellIndex;
-};
 struct ForceAverage {
     void addForce(Vec2 const& f) {
         force += f;
@@ -57,28 +90,46 @@ struct ForceAverage {
     float maxTranslation = 0;
     float maxForce = 0;
 };
+// colliders of static Physics2D bodies are kept in a separate world built
+// once, they are paired with moving bodies only
 class CollisionSystem2D {
    public:
-    CollisionSystem2D(Vec2 worldSize);
-    void checkCollisions(ecs::EcsContainer& ecsContainer, scalar_t dt);
+    CollisionSystem2D(Vec2 worldSize,
+                      BroadPhaseType broadPhase = BroadPhaseType::GRID);
+    static SystemAccess getAccess();
+    // sends CollisionBegan, CollisionEnded and HitboxHit events
+    void checkCollisions(ecs::EcsContainer& ecsContainer, EventBus& events,
+                         scalar_t dt);
     bool areColliding(ecs::EcsContainer& ecsContainer, Entity a, Entity b,
                       MinimumTranslation& outMtv) const;
     bool areColliding(ecs::EcsContainer& ecsContainer, Collider2D const& a,
                       Collider2D const& b, MinimumTranslation& outMtv) const;
     void renderBoundingBoxes(ecs::EcsContainer& ecsContainer,
                              Renderer& renderer, Shader const& shader);
+    // the grid only sees bodies inside worldSize, the others have no bounds
+    void setBroadPhase(BroadPhaseType type);
+    BroadPhaseType getBroadPhase() const noexcept { return broadPhaseType; }
+    // pairs are tested in parallel once a pool is set, collisions are still
+    // resolved in the order of a serial run
+    inline void setThreadPool(ThreadPool& pool) { threadPool = &pool; }
 
    private:
-    using pair_t = std::pair<Entity, Entity>;
-    struct SetCmp {
-        bool operator()(pair_t a, pair_t b) const {
-            if (a.first > a.second) a = pair_t{a.second, a.first};
-            if (b.first > b.second) b = pair_t{b.second, b.first};
-            return a < b;
-        }
+    // colliders of a pair that overlap, waiting to be resolved
+    struct NarrowPhaseHit {
+        BaseCollider2D const* cA;
+        BaseCollider2D const* cB;
+        Entity a;
+        Entity b;
+        int indexA;
+        int indexB;
+        MinimumTranslation mtv;
     };
+    static constexpr size_t NARROW_PHASE_GRAIN = 64;
+
     void broadPhase(ecs::EcsContainer& ecsContainer);
-    void addDetectionData(Entity const& entity, Vec4 const& boundingBox);
+    // tests potentialCollisions[begin, end) and appends the hits in order
+    void narrowPhase(size_t begin, size_t end,
+                     std::vector<NarrowPhaseHit>& hits) const;
     Vec4 findClosestVertexToPoint(
         Vec4 const& point,
         std::vector<ColliderData> const& worldSpaceData) const;
@@ -88,8 +139,12 @@ class CollisionSystem2D {
     void findMinMaxProjectionCircle(Vec4 const& center, scalar_t radius,
                                     Vec2 const& normal, scalar_t& inOutMin,
                                     scalar_t& inOutMax) const;
-    void resolveCollision(ecs::EcsContainer& ecsContainer,
+    void resolveCollision(ecs::EcsContainer& ecsContainer, EventBus& events,
                           CollisionData const& collision, scalar_t dt);
+    void addContact(CollisionData const& collision);
+    // contacts of this frame missing in the previous one and the other way
+    // around
+    void sendContactEvents(EventBus& events);
     bool polygonPolygon(BaseCollider2D const& c1, BaseCollider2D const& c2,
                         MinimumTranslation& out) const;
     bool polygonCircle(BaseCollider2D const& c1, BaseCollider2D const& c2,
@@ -103,12 +158,27 @@ class CollisionSystem2D {
     inline scalar_t cross2DAnalog(Vec4 const& v1, Vec4 const& v2) const {
         return v1[0] * v2[1] - v1[1] * v2[0];
     }
-    std::vector<DetectionData> detections;
-    std::set<pair_t, SetCmp> potentialCollisions;
+    ThreadPool* threadPool = nullptr;
+    BroadPhaseType broadPhaseType;
+    GridBroadPhase grid;
+    TreeBroadPhase tree;
+    SweepAndPruneBroadPhase sweepAndPrune;
+    // colliders of static Physics2D bodies
+    StaticBroadPhase staticWorld;
+    Tick lastRun = 0;
+    // entities with a Collider2D, the moving ones owning boxes followed by
+    // the static ones; potentialCollisions holds their indices
+    std::vector<Entity> bodies;
+    std::vector<Collider2D const*> bodyColliders;
+    std::vector<Collider2D const*> staticColliders;
+    std::vector<Vec4> boxes;
+    PairBuffer potentialCollisions;
+    // hits of the pair ranges [i * NARROW_PHASE_GRAIN, (i + 1) *
+    // NARROW_PHASE_GRAIN), in pair order
+    std::vector<std::vector<NarrowPhaseHit>> hitRanges;
+    // physics contacts sorted by entities and colliders
+    std::vector<CollisionBegan> contacts;
+    std::vector<CollisionBegan> previousContacts;
     std::vector<ForceAverage> forces;
-    Vec2 worldSize;
-    Vec2 cellSize;
-    scalar_t totalRows;
-    scalar_t totalCols;
 };
 }  // namespace ecs
\ No newline at end of file
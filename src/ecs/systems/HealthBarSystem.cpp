@@ -1,17 +1,19 @@
 #include "HealthBarSystem.h"
 #include "../components/HealthBar.h"
 #include "../components/Transform2D.h"
+#include "../../Utils.h"
+#include <algorithm>
+#include <iostream>
+#include <tuple>
 
 namespace ecs {
+SystemAccess HealthBarSystem::getAccess() { return writes<HealthBar>(); }
+
 void HealthBarSystem::update(EcsContainer& ecsContainer, Renderer& renderer,
                              Shader const& shader) {
-    auto& components =
+    auto components =
         ecsContainer.getEntitiesWithComponents<HealthBar, Transform2D>();
-    for (auto& [healthBar, transform] : components) {
-        if (healthBar->getCurrentValue() == 0) {
-            deadEntities.emplace_back(healthBar->getEntity());
-        }
-
+    for (auto [healthBar, transform] : components) {
         bool flipY = transform->modelToWorld()[0] < 0;
         auto meshId = renderer.addMesh(healthBar->getMesh(flipY));
         renderer.getMesh(meshId).transformPosition(transform->modelToWorld());
@@ -20,17 +22,104 @@ void HealthBarSystem::update(EcsContainer& ecsContainer, Renderer& renderer,
         rc.opaque = true;
         renderer.addRenderCommand(rc);
     }
+}
+
+namespace {
+auto cooldownKey(Entity const& source, int collider, Entity const& target) {
+    return std::tuple(source.getHandle(), collider, target.getHandle());
+}
+
+template <typename Cooldowns>
+auto findCooldown(Cooldowns& cooldowns, Entity const& source, int collider,
+                  Entity const& target) {
+    auto key = cooldownKey(source, collider, target);
+    return std::lower_bound(cooldowns.begin(), cooldowns.end(), key,
+                            [](auto const& cooldown, auto const& key) {
+                                return cooldownKey(cooldown.source,
+                                                   cooldown.collider,
+                                                   cooldown.target) < key;
+                            });
+}
+}  // namespace
 
-    for (auto const& cb : onDeadCbs) {
-        for (auto const& entity : deadEntities) {
-            cb(ecsContainer, entity);
+void HealthBarSystem::applyDamage(EcsContainer& ecsContainer,
+                                  EventBus& events) {
+    for (auto const& hit : events.read<HitboxHit>()) {
+        dealDamage(ecsContainer, events, hit.source, hit.damage, hit.target);
+    }
+    auto untouch = [&](Entity const& source, int collider,
+                       Entity const& target) {
+        auto it = findCooldown(cooldowns, source, collider, target);
+        if (it != cooldowns.end() && it->source == source &&
+            it->collider == collider && it->target == target) {
+            it->touching = false;
         }
+    };
+    for (auto const& contact : events.read<CollisionEnded>()) {
+        untouch(contact.a, contact.colliderA, contact.b);
+        untouch(contact.b, contact.colliderB, contact.a);
+    }
+    for (auto const& contact : events.read<CollisionBegan>()) {
+        touch(ecsContainer, events, contact.a, contact.colliderA,
+              contact.damageA, contact.b);
+        touch(ecsContainer, events, contact.b, contact.colliderB,
+              contact.damageB, contact.a);
     }
-    deadEntities.clear();
+    for (auto& cooldown : cooldowns) {
+        if (cooldown.touching &&
+            cooldown.lastHit.resetIfOlderThanMs(cooldown.damage.cooldownMs)) {
+            dealDamage(ecsContainer, events, cooldown.source, cooldown.damage,
+                       cooldown.target);
+        }
+    }
+    std::erase_if(cooldowns, [&](Cooldown const& cooldown) {
+        return !ecsContainer.exists(cooldown.source) ||
+               !ecsContainer.exists(cooldown.target) ||
+               (!cooldown.touching &&
+                cooldown.lastHit.isOlderThanMs(cooldown.damage.cooldownMs));
+    });
 }
 
-size_t HealthBarSystem::onDeadEntity(CallbackType cb) {
-    onDeadCbs.emplace_back(cb);
-    return onDeadCbs.size() - 1;
+void HealthBarSystem::touch(EcsContainer& ecsContainer, EventBus& events,
+                            Entity const& source, int collider,
+                            DamageRange const& damage, Entity const& target) {
+    if (damage.cooldownMs <= 0) {
+        dealDamage(ecsContainer, events, source, damage, target);
+        return;
+    }
+    auto it = findCooldown(cooldowns, source, collider, target);
+    if (it == cooldowns.end() || it->source != source ||
+        it->collider != collider || it->target != target) {
+        // starts touching with the hit dealt right below
+        cooldowns.insert(it, Cooldown{source, collider, target, damage,
+                                      utils::TimeStamp{}, true});
+        dealDamage(ecsContainer, events, source, damage, target);
+        return;
+    }
+    // touching again before the cooldown passed
+    it->touching = true;
+    if (it->lastHit.resetIfOlderThanMs(damage.cooldownMs)) {
+        dealDamage(ecsContainer, events, source, damage, target);
+    }
+}
+
+void HealthBarSystem::dealDamage(EcsContainer& ecsContainer, EventBus& events,
+                                 Entity const& source,
+                                 DamageRange const& damage,
+                                 Entity const& target) {
+    // either entity may have been removed since the event was sent
+    auto* hp = ecsContainer.getComponent<HealthBar>(target);
+    if (damage.max <= 0 || !ecsContainer.exists(source) || !hp ||
+        hp->getCurrentValue() == 0) {
+        return;
+    }
+    auto dmg = utils::RandomMatrix<scalar_t>::instance().getScalar(damage.min,
+                                                                   damage.max);
+    hp->changeHp(-dmg);
+    std::cout << "Entity " << source.getId() << " hit entity "
+              << target.getId() << " for " << dmg << "\n";
+    if (hp->getCurrentValue() == 0) {
+        events.send(EntityDied{target});
+    }
 }
-}  // namespace ecs
\ No newline at end of file
+}  // namespace ecs
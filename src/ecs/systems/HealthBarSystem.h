@@ -1,21 +1,48 @@
 #pragma once
 #include "Renderer.h"
+#include "CollisionSystem2D.h"
 #include "../EcsContainer.h"
+#include "../EventBus.h"
 #include "../../opengl/Shader.h"
+#include "../../Utils.h"
 #include <vector>
-#include <functional>
 
 namespace ecs {
+// health of an entity dropped to 0
+struct EntityDied {
+    Entity entity;
+};
+
 class HealthBarSystem {
    public:
-    using CallbackType = std::function<void(EcsContainer&, Entity)>;
+    static SystemAccess getAccess();
     void update(EcsContainer& ecsContainer, Renderer& renderer,
                 Shader const& shader);
-    // TODO: event system / unsubscribe option
-    size_t onDeadEntity(CallbackType fn);
+    // deals the damage of colliders from HitboxHit and CollisionBegan events
+    // and again after the cooldown of a collider while it keeps touching,
+    // sends EntityDied
+    void applyDamage(EcsContainer& ecsContainer, EventBus& events);
 
    private:
-    std::vector<Entity> deadEntities;
-    std::vector<CallbackType> onDeadCbs;
+    // last hit of a collider with a cooldown, kept until the cooldown passed
+    // after the contact ended
+    struct Cooldown {
+        Entity source;
+        int collider = 0;
+        Entity target;
+        DamageRange damage;
+        utils::TimeStamp lastHit;
+        bool touching = true;
+    };
+
+    void touch(EcsContainer& ecsContainer, EventBus& events,
+               Entity const& source, int collider, DamageRange const& damage,
+               Entity const& target);
+    void dealDamage(EcsContainer& ecsContainer, EventBus& events,
+                    Entity const& source, DamageRange const& damage,
+                    Entity const& target);
+
+    // sorted by source, collider and target
+    std::vector<Cooldown> cooldowns;
 };
 }  // namespace ecs
@@ -0,0 +1,112 @@
+#include "HierarchySystem.h"
+#include "../components/Hierarchy2D.h"
+#include "../components/Transform2D.h"
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+
+namespace ecs {
+SystemAccess HierarchySystem::getAccess() {
+    return writes<Transform2D, Hierarchy2D>();
+}
+
+void HierarchySystem::update(EcsContainer& ecsContainer) {
+    auto since = std::exchange(lastRun, advanceTick());
+    if (isOrderOutdated(ecsContainer, since)) {
+        sortNodes(ecsContainer);
+    }
+    auto treeCount = trees.empty() ? 0 : trees.size() - 1;
+    auto propagateTrees = [&](size_t begin, size_t end) {
+        for (auto tree = begin; tree < end; ++tree) {
+            propagate(ecsContainer, trees[tree], trees[tree + 1]);
+        }
+    };
+    if (threadPool) {
+        threadPool->parallelFor(treeCount, 1, propagateTrees);
+    } else {
+        propagateTrees(0, treeCount);
+    }
+    // changes made after this run get a newer tick than the parent ticks
+    // recorded in it
+    advanceTick();
+}
+
+// children were added, removed or moved to another parent
+bool HierarchySystem::isOrderOutdated(EcsContainer& ecsContainer,
+                                      Tick since) const {
+    auto query = ecsContainer.getEntitiesWithComponents<Transform2D,
+                                                         Hierarchy2D>();
+    if (query.size() != nodes.size()) {
+        return true;
+    }
+    for (auto [transform, hierarchy] : query) {
+        if (hierarchy->changedSince(since)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HierarchySystem::sortNodes(EcsContainer& ecsContainer) {
+    auto query = ecsContainer.getEntitiesWithComponents<Transform2D,
+                                                         Hierarchy2D>();
+    nodes.clear();
+    for (auto [transform, hierarchy] : query) {
+        Node node{transform->getEntity(), hierarchy->getParent(),
+                  hierarchy->getParent(), 1};
+        // the root is the first ancestor without a parent
+        while (auto* ancestor =
+                   ecsContainer.exists(node.root)
+                       ? ecsContainer.getComponent<Hierarchy2D>(node.root)
+                       : nullptr) {
+            if (++node.depth > query.size()) {
+                throw std::runtime_error("Cycle in transform hierarchy");
+            }
+            node.root = ancestor->getParent();
+        }
+        hierarchy->depth = node.depth;
+        nodes.emplace_back(node);
+    }
+    std::sort(nodes.begin(), nodes.end(), [](Node const& a, Node const& b) {
+        return std::make_tuple(a.root.getHandle(), a.depth) <
+               std::make_tuple(b.root.getHandle(), b.depth);
+    });
+    trees.clear();
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (i == 0 || nodes[i].root != nodes[i - 1].root) {
+            trees.push_back(i);
+        }
+    }
+    trees.push_back(nodes.size());
+}
+
+void HierarchySystem::propagate(EcsContainer& ecsContainer, size_t begin,
+                                size_t end) {
+    for (auto i = begin; i < end; ++i) {
+        auto const& node = nodes[i];
+        auto* transform = ecsContainer.getComponent<Transform2D>(node.entity);
+        auto* hierarchy = ecsContainer.getComponent<Hierarchy2D>(node.entity);
+        auto* parent = ecsContainer.exists(node.parent)
+                           ? ecsContainer.getComponent<Transform2D>(node.parent)
+                           : nullptr;
+        if (!parent) {
+            // the parent is gone, the child falls back to its local transform
+            if (transform->hasParent()) {
+                transform->clearParentTransform();
+            }
+            hierarchy->synced = false;
+            continue;
+        }
+        if (hierarchy->synced &&
+            hierarchy->parentTick == parent->getChangedTick()) {
+            continue;
+        }
+        transform->setParentTransform(parent->modelToWorld(),
+                                      parent->normalsRotation(),
+                                      parent->getWorldScaleFactor());
+        hierarchy->parentTick = parent->getChangedTick();
+        hierarchy->synced = true;
+    }
+}
+}  // namespace ecs
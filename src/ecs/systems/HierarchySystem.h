@@ -0,0 +1,41 @@
+#pragma once
+#include "../EcsContainer.h"
+#include "../SystemScheduler.h"
+#include "../../ThreadPool.h"
+#include <vector>
+
+namespace ecs {
+/*
+Propagates world transforms from parents to the children of Hierarchy2D
+components. Children are kept sorted by root and depth, so a parent is always
+done before its children, and a child is refreshed only if its parent's
+transform changed since it was last propagated. Refreshing stamps the child in
+turn, so only dirty subtrees are recomputed. Trees of different roots are
+independent and refreshed in parallel once a pool is set.
+*/
+class HierarchySystem {
+   public:
+    static SystemAccess getAccess();
+    void update(EcsContainer& ecsContainer);
+    inline void setThreadPool(ThreadPool& pool) { threadPool = &pool; }
+
+   private:
+    struct Node {
+        Entity entity;
+        Entity parent;
+        Entity root;
+        uint32_t depth = 0;
+    };
+
+    bool isOrderOutdated(EcsContainer& ecsContainer, Tick since) const;
+    void sortNodes(EcsContainer& ecsContainer);
+    void propagate(EcsContainer& ecsContainer, size_t begin, size_t end);
+
+    ThreadPool* threadPool = nullptr;
+    Tick lastRun = 0;
+    // sorted by root, then depth
+    std::vector<Node> nodes;
+    // offsets of the trees in nodes, followed by nodes.size()
+    std::vector<size_t> trees;
+};
+}  // namespace ecs
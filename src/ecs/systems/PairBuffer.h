@@ -0,0 +1,79 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace ecs {
+/*
+Flat list of potentially colliding pairs written by a broadphase. A pair of
+body indices is packed into one 64 bit key with the smaller index in the high
+half, so the same pair added in either order gets the same key. finalize()
+sorts the keys with a radix sort and drops duplicates, clear() keeps the
+memory for the next frame.
+*/
+class PairBuffer {
+   public:
+    using Pair = std::pair<uint32_t, uint32_t>;
+
+    static constexpr uint64_t pack(uint32_t a, uint32_t b) noexcept {
+        if (b < a) std::swap(a, b);
+        return uint64_t{a} << 32 | b;
+    }
+    static constexpr Pair unpack(uint64_t key) noexcept {
+        return {static_cast<uint32_t>(key >> 32), static_cast<uint32_t>(key)};
+    }
+
+    void add(uint32_t a, uint32_t b) { keys.emplace_back(pack(a, b)); }
+    // sorts the pairs by (smaller, larger) index and removes duplicates
+    void finalize();
+    void clear() noexcept { keys.clear(); }
+    size_t size() const noexcept { return keys.size(); }
+    bool empty() const noexcept { return keys.empty(); }
+    Pair operator[](size_t i) const noexcept { return unpack(keys[i]); }
+    std::span<uint64_t const> getKeys() const noexcept { return keys; }
+
+   private:
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> scratch;
+};
+
+inline void PairBuffer::finalize() {
+    constexpr size_t DIGITS = sizeof(uint64_t);
+    if (keys.size() < 2) {
+        return;
+    }
+    // least significant digit first, one byte per pass; all histograms are
+    // counted in a single read and passes where every key has the same digit
+    // are skipped, with small indices most of the high bytes are zero
+    std::array<std::array<size_t, 256>, DIGITS> counts{};
+    for (auto key : keys) {
+        for (size_t d = 0; d < DIGITS; ++d) {
+            ++counts[d][key >> d * 8 & 0xff];
+        }
+    }
+    scratch.resize(keys.size());
+    for (size_t d = 0; d < DIGITS; ++d) {
+        auto& count = counts[d];
+        if (count[keys.front() >> d * 8 & 0xff] == keys.size()) {
+            continue;
+        }
+        size_t offset = 0;
+        for (auto& c : count) {
+            offset += std::exchange(c, offset);
+        }
+        for (auto key : keys) {
+            scratch[count[key >> d * 8 & 0xff]++] = key;
+        }
+        std::swap(keys, scratch);
+    }
+    size_t last = 0;
+    for (size_t i = 1; i < keys.size(); ++i) {
+        if (keys[i] != keys[last]) {
+            keys[++last] = keys[i];
+        }
+    }
+    keys.resize(last + 1);
+}
+}  // namespace ecs
@@ -3,36 +3,63 @@
 #include "../components/Transform2D.h"
 #include "../components/Collider2D.h"
 #include <cmath>
+#include <utility>
 
 namespace ecs {
+SystemAccess PhysicsSystem::getAccess() {
+    return writes<Transform2D, Physics2D, Collider2D>();
+}
+
 void PhysicsSystem::update(CollisionSystem2D const& cs,
                            ecs::EcsContainer& ecsContainer, scalar_t dt) {
-    for (auto& transform : ForEachComponent<Transform2D>(ecsContainer)) {
-        auto const& entity = transform.getEntity();
-        auto* physics = ecsContainer.getComponent<Physics2D>(entity);
-        auto* collider = ecsContainer.getComponent<Collider2D>(entity);
-        if (physics) {
-            if (!physics->isStatic()) {
-                auto vel = physics->getLinearVelocity();
-                auto pos = transform.getPosition();
-                transform.rotate(physics->getAngularVelocity() * dt);
+    auto since = std::exchange(lastRun, advanceTick());
+    // static geometry keeps its world space vertices
+    auto updateCollider = [&](Transform2D& transform, Collider2D& collider) {
+        if (transform.changedSince(since) || collider.changedSince(since)) {
+            collider.update(transform.modelToWorld(),
+                            transform.normalsRotation(),
+                            transform.getWorldScaleFactor());
+        }
+    };
+    // touches only the components of one entity
+    auto integrate = [&](Transform2D* transform, Physics2D* physics,
+                         Collider2D* collider) {
+        if (!physics->isStatic()) {
+            auto vel = physics->getLinearVelocity();
+            auto pos = transform->getPosition();
+            transform->rotate(physics->getAngularVelocity() * dt);
 
-                if (!physics->isGrounded() && gravityEnabled) {
-                    physics->setLinearVelocity(vel + gravity * dt);
-                } else {
-                    physics->addToRestVelocity(-gravity[1] * dt);
-                    if (physics->getRestVelocity() > -gravity[1] * dt * 2) {
-                        physics->setGrounded(false);
-                    }
+            if (!physics->isGrounded() && gravityEnabled) {
+                physics->setLinearVelocity(vel + gravity * dt);
+            } else {
+                physics->addToRestVelocity(-gravity[1] * dt);
+                if (physics->getRestVelocity() > -gravity[1] * dt * 2) {
+                    physics->setGrounded(false);
                 }
-                transform.setPosition(pos + physics->getLinearVelocity() * dt);
             }
+            transform->setPosition(pos + physics->getLinearVelocity() * dt);
         }
         if (collider) {
-            collider->update(transform.modelToWorld(),
-                             transform.normalsRotation(),
-                             transform.getScaleFactor());
+            updateCollider(*transform, *collider);
         }
+    };
+    auto updateStatic = [&](Transform2D* transform, Collider2D* collider) {
+        updateCollider(*transform, *collider);
+    };
+    auto bodies = ecsContainer.getEntitiesWithComponents<
+        Transform2D, Physics2D, Optional<Collider2D>>();
+    auto colliders = ecsContainer.getEntitiesWithComponents<
+        Transform2D, Collider2D, Without<Physics2D>>();
+    if (threadPool) {
+        parallelForEach(*threadPool, bodies, integrate);
+        parallelForEach(*threadPool, colliders, updateStatic);
+        return;
+    }
+    for (auto [transform, physics, collider] : bodies) {
+        integrate(transform, physics, collider);
+    }
+    for (auto [transform, collider] : colliders) {
+        updateStatic(transform, collider);
     }
 }
 }  // namespace ecs
\ No newline at end of file
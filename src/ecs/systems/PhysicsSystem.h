@@ -1,17 +1,23 @@
 #pragma once
 #include "CollisionSystem2D.h"
+#include "../SystemScheduler.h"
 #include "../../Types.h"
 
 namespace ecs {
 class PhysicsSystem {
    public:
+    static SystemAccess getAccess();
     void update(CollisionSystem2D const& cs, ecs::EcsContainer& ecsContainer,
                 scalar_t dt);
     inline void enableGravity(bool value) { gravityEnabled = value; }
     inline void setGravity(Vec2 const& value) { gravity = value; }
     inline void toggleGravity() { gravityEnabled = !gravityEnabled; }
+    // entities are integrated in parallel once a pool is set
+    inline void setThreadPool(ThreadPool& pool) { threadPool = &pool; }
 
    private:
+    ThreadPool* threadPool = nullptr;
+    Tick lastRun = 0;
     Vec2 gravity = {0, -10.0};
     bool gravityEnabled = true;
 };
@@ -2,19 +2,24 @@
 #include "../components/Transform2D.h"
 #include "../components/StaticSprite.h"
 #include "../components/AnimatedSprite.h"
+#include <utility>
 namespace ecs {
 void SpriteSystem::update(EcsContainer& container, Renderer& renderer,
                           Shader const& shader, Mat4 const& projectionView,
                           scalar_t dt) {
-    auto& staticComponents =
+    auto staticComponents =
         container.getEntitiesWithComponents<Transform2D, StaticSprite>();
-    auto& animatedComponents =
+    auto animatedComponents =
         container.getEntitiesWithComponents<Transform2D, AnimatedSprite>();
 
-    for (auto& [transform, sprite] : staticComponents) {
-        auto meshId = renderer.addMesh(sprite->getMesh());
-        renderer.getMesh(meshId).transformPosition(transform->modelToWorld());
-        renderer.getMesh(meshId).setDepth(transform->getNdcDepth());
+    auto since = std::exchange(lastRun, advanceTick());
+    for (auto [transform, sprite] : staticComponents) {
+        // most static sprites never move, their mesh is transformed once
+        if (transform->changedSince(since) || sprite->changedSince(since)) {
+            sprite->updateWorldMesh(transform->modelToWorld(),
+                                    transform->getNdcDepth());
+        }
+        auto meshId = renderer.addMesh(sprite->getWorldMesh());
         RenderCommand rc(meshId, shader);
         rc.texture = sprite->getTexture();
         rc.state.depthState.enabled = true;
@@ -23,7 +28,7 @@ void SpriteSystem::update(EcsContainer& container, Renderer& renderer,
         renderer.addRenderCommand(rc);
     }
 
-    for (auto& [transform, sprite] : animatedComponents) {
+    for (auto [transform, sprite] : animatedComponents) {
         sprite->update(container, sprite->getEntity(), dt);
         sprite->play(container, sprite->getEntity());
         auto meshId = renderer.addMesh(sprite->getMesh());
@@ -7,5 +7,8 @@ class SpriteSystem {
    public:
     void update(EcsContainer& container, Renderer& renderer,
                 Shader const& shader, Mat4 const& projectionView, scalar_t dt);
+
+   private:
+    Tick lastRun = 0;
 };
 }  // namespace ecs
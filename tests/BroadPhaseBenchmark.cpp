@@ -0,0 +1,132 @@
+// compares the broadphases on moving boxes, run without arguments:
+// BroadPhaseBenchmark [frames]
+#include "src/ecs/systems/BroadPhase.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+namespace {
+struct Scene {
+    std::string name;
+    scalar_t spread = 0;  // boxes bounce inside [-spread, spread]
+    size_t staticCount = 0;  // the first boxes do not move
+    std::vector<ecs::Entity> bodies;
+    std::vector<Vec4> boxes;
+    std::vector<Vec2> velocities;
+};
+
+// count boxes of the given size range moving up to speed per frame
+void addBoxes(Scene& scene, std::mt19937& random, size_t count,
+              scalar_t minSize, scalar_t maxSize, scalar_t speed) {
+    std::uniform_real_distribution<scalar_t> position(-scene.spread,
+                                                      scene.spread);
+    std::uniform_real_distribution<scalar_t> size(minSize, maxSize);
+    std::uniform_real_distribution<scalar_t> velocity(-speed, speed);
+    for (size_t i = 0; i < count; ++i) {
+        scene.bodies.emplace_back(
+            static_cast<ecs::EntityId>(scene.bodies.size()), 0);
+        scene.boxes.emplace_back(Vec4({position(random), position(random),
+                                       size(random), size(random)}));
+        scene.velocities.emplace_back(velocity(random), velocity(random));
+    }
+}
+
+void step(Scene& scene) {
+    for (size_t i = scene.staticCount; i < scene.boxes.size(); ++i) {
+        auto& box = scene.boxes[i];
+        auto& velocity = scene.velocities[i];
+        for (int axis = 0; axis < 2; ++axis) {
+            box[axis] += velocity[axis];
+            if (box[axis] < -scene.spread || box[axis] > scene.spread) {
+                velocity[axis] = -velocity[axis];
+            }
+        }
+    }
+}
+
+template <typename FindPairs>
+void run(char const* broadPhase, Scene scene, int frames,
+         FindPairs&& findPairs) {
+    ecs::PairBuffer pairs;
+    size_t pairCount = 0;
+    std::chrono::nanoseconds total{0};
+    for (int frame = 0; frame < frames; ++frame) {
+        step(scene);
+        auto start = std::chrono::steady_clock::now();
+        findPairs(scene, pairs);
+        total += std::chrono::steady_clock::now() - start;
+        pairCount += pairs.size();
+    }
+    std::printf("%-10s %-6s %10.3f ms/frame %10zu pairs/frame\n",
+                scene.name.c_str(), broadPhase,
+                std::chrono::duration<double, std::milli>(total).count() /
+                    frames,
+                pairCount / frames);
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? std::atoi(argv[1]) : 200;
+    std::mt19937 random(1);
+    std::vector<Scene> scenes(4);
+    scenes[0].name = "uniform";
+    scenes[0].spread = 48;
+    addBoxes(scenes[0], random, 5000, 0.3f, 1, 0.05f);
+    // a few large bodies cover hundreds of grid cells each
+    scenes[1].name = "mixed";
+    scenes[1].spread = 48;
+    addBoxes(scenes[1], random, 5000, 0.3f, 1, 0.05f);
+    addBoxes(scenes[1], random, 20, 10, 30, 0.05f);
+    scenes[2].name = "pile";
+    scenes[2].spread = 5;
+    addBoxes(scenes[2], random, 3000, 0.5f, 1, 0.01f);
+    // mostly static geometry
+    scenes[3].name = "level";
+    scenes[3].spread = 48;
+    scenes[3].staticCount = 5000;
+    addBoxes(scenes[3], random, 5000, 0.5f, 2, 0);
+    addBoxes(scenes[3], random, 300, 0.3f, 1, 0.05f);
+
+    for (auto const& scene : scenes) {
+        ecs::GridBroadPhase grid(Vec2{100, 100});
+        run("grid", scene, frames,
+            [&](Scene const& s, ecs::PairBuffer& pairs) {
+                grid.findPairs(s.boxes, pairs);
+            });
+        ecs::TreeBroadPhase tree;
+        run("tree", scene, frames,
+            [&](Scene const& s, ecs::PairBuffer& pairs) {
+                tree.findPairs(s.bodies, s.boxes, pairs);
+            });
+        ecs::SweepAndPruneBroadPhase sweepAndPrune;
+        run("sap", scene, frames,
+            [&](Scene const& s, ecs::PairBuffer& pairs) {
+                sweepAndPrune.findPairs(s.bodies, s.boxes, pairs);
+            });
+        if (scene.staticCount == 0) {
+            continue;
+        }
+        // static boxes kept apart, the moving ones in a tree
+        ecs::StaticBroadPhase staticWorld;
+        ecs::TreeBroadPhase dynamicTree;
+        run("static", scene, frames,
+            [&](Scene const& s, ecs::PairBuffer& pairs) {
+                auto staticCount = s.staticCount;
+                std::span<Vec4 const> boxes(s.boxes);
+                staticWorld.beginFrame();
+                for (size_t i = 0; i < staticCount; ++i) {
+                    staticWorld.addBody(s.bodies[i], false,
+                                        [&] { return boxes[i]; });
+                }
+                auto dynamicBoxes = boxes.subspan(staticCount);
+                dynamicTree.findPairs(
+                    std::span(s.bodies).subspan(staticCount), dynamicBoxes,
+                    pairs);
+                staticWorld.findPairs(dynamicBoxes, pairs);
+                pairs.finalize();
+            });
+    }
+    return 0;
+}
@@ -0,0 +1,1253 @@
+#include <gtest/gtest.h>
+#include "src/ecs/EcsContainer.h"
+#include "src/ecs/SystemScheduler.h"
+#include "src/ecs/CommandBuffer.h"
+#include "src/ecs/EventBus.h"
+#include "src/ecs/RollbackBuffer.h"
+#include "src/ecs/WorldSnapshot.h"
+#include "src/ecs/components/BoxCollider.h"
+#include "src/ecs/components/CircleCollider.h"
+#include "src/ecs/components/Collider2D.h"
+#include "src/ecs/components/HealthBar.h"
+#include "src/ecs/components/Hierarchy2D.h"
+#include "src/ecs/components/Physics2D.h"
+#include "src/ecs/components/Transform2D.h"
+#include "src/ecs/systems/AiSystem.h"
+#include "src/ecs/systems/CollisionSystem2D.h"
+#include "src/ecs/systems/HealthBarSystem.h"
+#include "src/ecs/systems/HierarchySystem.h"
+#include "src/ecs/systems/PhysicsSystem.h"
+#include "src/ecs/systems/BroadPhase.h"
+#include "src/ecs/systems/PairBuffer.h"
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace {
+struct PositionTag {};
+struct VelocityTag {};
+struct NameTag {};
+using TestTags = TypeSequence<PositionTag, VelocityTag, NameTag>;
+
+struct Position : ecs::ComponentBase<Position, PositionTag, TestTags> {
+    Position() = default;
+    Position(float x, float y) : x(x), y(y) {}
+    float x = 0;
+    float y = 0;
+};
+
+struct Velocity : ecs::ComponentBase<Velocity, VelocityTag, TestTags> {
+    static constexpr bool trivially_relocatable = true;
+
+    Velocity() = default;
+    Velocity(float dx, float dy) : dx(dx), dy(dy) {}
+    float dx = 0;
+    float dy = 0;
+};
+
+// not trivially copyable, checks that components are moved correctly
+struct Name : ecs::ComponentBase<Name, NameTag, TestTags> {
+    Name(std::string value) : value(std::move(value)) {}
+    std::string value;
+};
+
+class EcsStorageTests : public ::testing::TestWithParam<ecs::StorageMode> {
+   protected:
+    ecs::EcsContainer ecs{TestTags{}, GetParam()};
+};
+}  // namespace
+
+TEST_P(EcsStorageTests, addAndGetComponents) {
+    auto a = ecs.createEntity();
+    auto b = ecs.createEntity();
+    ecs.addComponent<Position>(a, 1.f, 2.f);
+    ecs.addComponent<Position>(b, 3.f, 4.f);
+    ecs.addComponent<Name>(a, "a");
+    ecs.addComponent<Velocity>(a, 5.f, 6.f);
+
+    EXPECT_EQ(1.f, ecs.getComponent<Position>(a)->x);
+    EXPECT_EQ(4.f, ecs.getComponent<Position>(b)->y);
+    EXPECT_EQ(6.f, ecs.getComponent<Velocity>(a)->dy);
+    EXPECT_EQ("a", ecs.getComponent<Name>(a)->value);
+    EXPECT_EQ(nullptr, ecs.getComponent<Velocity>(b));
+    EXPECT_EQ(a, ecs.getComponent<Name>(a)->getEntity());
+}
+
+TEST_P(EcsStorageTests, removeComponentKeepsOtherEntities) {
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 100; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        ecs.addComponent<Name>(e, std::to_string(i));
+        ecs.addComponent<Velocity>(e, 0.f, static_cast<float>(i));
+        entities.push_back(e);
+    }
+    for (int i = 0; i < 100; i += 3) {
+        ecs.removeComponent<Velocity>(entities[i]);
+    }
+    for (int i = 0; i < 100; ++i) {
+        auto e = entities[i];
+        EXPECT_EQ(static_cast<float>(i), ecs.getComponent<Position>(e)->x);
+        EXPECT_EQ(std::to_string(i), ecs.getComponent<Name>(e)->value);
+        auto* velocity = ecs.getComponent<Velocity>(e);
+        if (i % 3 == 0) {
+            EXPECT_EQ(nullptr, velocity);
+        } else {
+            ASSERT_NE(nullptr, velocity);
+            EXPECT_EQ(static_cast<float>(i), velocity->dy);
+        }
+    }
+}
+
+TEST_P(EcsStorageTests, removeLastComponentOfType) {
+    auto a = ecs.createEntity();
+    auto b = ecs.createEntity();
+    ecs.addComponent<Name>(a, std::string(64, 'a'));
+    ecs.addComponent<Name>(b, std::string(64, 'b'));
+    ecs.addComponent<Velocity>(a, 1.f, 1.f);
+    ecs.addComponent<Velocity>(b, 2.f, 2.f);
+    ecs.removeComponent<Name>(b);
+    ecs.removeComponent<Velocity>(b);
+    EXPECT_EQ(nullptr, ecs.getComponent<Name>(b));
+    EXPECT_EQ(std::string(64, 'a'), ecs.getComponent<Name>(a)->value);
+    EXPECT_EQ(1.f, ecs.getComponent<Velocity>(a)->dx);
+    ecs.removeComponent<Name>(a);
+    ecs.addComponent<Name>(b, "b");
+    EXPECT_EQ("b", ecs.getComponent<Name>(b)->value);
+}
+
+TEST_P(EcsStorageTests, queryFollowsStructuralChanges) {
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 2000; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        if (i % 2 == 0) {
+            ecs.addComponent<Velocity>(e, 1.f, 0.f);
+        }
+        entities.push_back(e);
+    }
+    auto moving = ecs.getEntitiesWithComponents<Position, Velocity>();
+    EXPECT_EQ(1000, moving.size());
+    for (auto [position, velocity] : moving) {
+        EXPECT_EQ(position->getEntity(), velocity->getEntity());
+    }
+    ecs.removeEntity(entities[0]);
+    ecs.removeComponent<Velocity>(entities[2]);
+    ecs.addComponent<Velocity>(entities[1], 1.f, 0.f);
+    auto updated = ecs.getEntitiesWithComponents<Position, Velocity>();
+    EXPECT_EQ(999, updated.size());
+    for (auto [position, velocity] : updated) {
+        EXPECT_EQ(position->getEntity(), velocity->getEntity());
+    }
+}
+
+TEST_P(EcsStorageTests, cachedQueryIsUpdatedInPlace) {
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 10; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        ecs.addComponent<Velocity>(e, 0.f, static_cast<float>(i));
+        entities.push_back(e);
+    }
+    auto query = ecs.getEntitiesWithComponents<Position, Velocity>();
+    EXPECT_EQ(10, query.size());
+    // growth past the initial capacity relocates every component
+    for (int i = 0; i < 500; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        ecs.addComponent<Velocity>(e, 0.f, static_cast<float>(i));
+        entities.push_back(e);
+    }
+    for (size_t i = 0; i < entities.size(); i += 4) {
+        ecs.removeComponent<Position>(entities[i]);
+    }
+    for (size_t i = 1; i < entities.size(); i += 4) {
+        ecs.removeEntity(entities[i]);
+    }
+    // views taken before the changes see them too
+    EXPECT_EQ(entities.size() / 2 - 1, query.size());
+    for (auto [position, velocity] : query) {
+        auto e = position->getEntity();
+        ASSERT_TRUE(ecs.exists(e));
+        EXPECT_EQ(position, ecs.getComponent<Position>(e));
+        EXPECT_EQ(velocity, ecs.getComponent<Velocity>(e));
+    }
+}
+
+TEST_P(EcsStorageTests, queryIdsAreStablePerComponentList) {
+    auto id = ecs::getQueryId<Position, Velocity>();
+    EXPECT_EQ(id, (ecs::getQueryId<Position, Velocity>()));
+    EXPECT_NE(id, (ecs::getQueryId<Velocity, Position>()));
+    EXPECT_NE(id, ecs::getQueryId<Position>());
+
+    auto e = ecs.createEntity();
+    ecs.addComponent<Position>(e, 1.f, 2.f);
+    ecs.addComponent<Velocity>(e, 3.f, 4.f);
+    auto positionFirst = ecs.getEntitiesWithComponents<Position, Velocity>();
+    auto velocityFirst = ecs.getEntitiesWithComponents<Velocity, Position>();
+    ASSERT_EQ(1, positionFirst.size());
+    ASSERT_EQ(1, velocityFirst.size());
+    EXPECT_EQ(1.f, std::get<0>(*positionFirst.begin())->x);
+    EXPECT_EQ(3.f, std::get<0>(*velocityFirst.begin())->dx);
+}
+
+TEST_P(EcsStorageTests, withoutAndOptionalTerms) {
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 300; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        if (i % 2 == 0) {
+            ecs.addComponent<Velocity>(e, static_cast<float>(i), 0.f);
+        }
+        if (i % 3 == 0) {
+            ecs.addComponent<Name>(e, std::to_string(i));
+        }
+        entities.push_back(e);
+    }
+    auto unnamed =
+        ecs.getEntitiesWithComponents<Position, ecs::Without<Name>>();
+    auto optional = ecs.getEntitiesWithComponents<ecs::Optional<Velocity>,
+                                                  Position, ecs::With<Name>>();
+    auto check = [&] {
+        size_t count = 0;
+        for (auto [position] : unnamed) {
+            EXPECT_EQ(nullptr, ecs.getComponent<Name>(position->getEntity()));
+            ++count;
+        }
+        EXPECT_EQ(count, unnamed.size());
+        count = 0;
+        for (auto [velocity, position] : optional) {
+            auto e = position->getEntity();
+            EXPECT_NE(nullptr, ecs.getComponent<Name>(e));
+            EXPECT_EQ(ecs.getComponent<Velocity>(e), velocity);
+            if (velocity) {
+                EXPECT_EQ(position->x, velocity->dx);
+            }
+            ++count;
+        }
+        EXPECT_EQ(count, optional.size());
+    };
+    EXPECT_EQ(200, unnamed.size());
+    EXPECT_EQ(100, optional.size());
+    check();
+
+    // gaining or losing optional or excluded components updates the views
+    for (int i = 0; i < 300; i += 5) {
+        if (i % 2 == 0) {
+            ecs.removeComponent<Velocity>(entities[i]);
+        } else {
+            ecs.addComponent<Velocity>(entities[i], static_cast<float>(i), 0.f);
+        }
+        if (i % 3 == 0) {
+            ecs.removeComponent<Name>(entities[i]);
+        } else {
+            ecs.addComponent<Name>(entities[i], "named");
+        }
+    }
+    ecs.removeEntity(entities[1]);
+    EXPECT_EQ(179, unnamed.size());
+    EXPECT_EQ(120, optional.size());
+    check();
+}
+
+TEST_P(EcsStorageTests, queryViewTakenBeforeEntitiesExist) {
+    auto query = ecs.getEntitiesWithComponents<Velocity, Position>();
+    EXPECT_TRUE(query.empty());
+    EXPECT_EQ(query.end(), query.begin());
+    for (int i = 0; i < 3000; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        ecs.addComponent<Velocity>(e, static_cast<float>(i), 0.f);
+        if (i % 5 == 0) {
+            ecs.addComponent<Name>(e, "other archetype");
+        }
+    }
+    size_t visited = 0;
+    for (auto [velocity, position] : query) {
+        EXPECT_EQ(position->getEntity(), velocity->getEntity());
+        EXPECT_EQ(position->x, velocity->dx);
+        ++visited;
+    }
+    EXPECT_EQ(3000, visited);
+    EXPECT_EQ(3000, query.size());
+}
+
+TEST_P(EcsStorageTests, moreThan65536Entities) {
+    constexpr int count = 100000;
+    std::vector<ecs::Entity> entities;
+    entities.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        auto e = ecs.createEntity();
+        if (i % 7 == 0) {
+            ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        }
+        entities.push_back(e);
+    }
+    for (int i = 0; i < count; i += 14) {
+        ecs.removeComponent<Position>(entities[i]);
+    }
+    for (int i = 0; i < count; ++i) {
+        auto* position = ecs.getComponent<Position>(entities[i]);
+        if (i % 7 == 0 && i % 14 != 0) {
+            ASSERT_NE(nullptr, position);
+            EXPECT_EQ(static_cast<float>(i), position->x);
+        } else {
+            EXPECT_EQ(nullptr, position);
+        }
+    }
+}
+
+TEST_P(EcsStorageTests, forEachVisitsEveryComponent) {
+    float expected = 0;
+    for (int i = 0; i < 3000; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        if (i % 5 == 0) {
+            ecs.addComponent<Name>(e, "");
+        }
+        expected += i;
+    }
+    float sum = 0;
+    size_t count = 0;
+    for (auto& position : ecs::ForEachComponent<Position>(ecs)) {
+        sum += position.x;
+        ++count;
+    }
+    EXPECT_EQ(3000, count);
+    EXPECT_EQ(expected, sum);
+    EXPECT_EQ(ecs.begin<Velocity>(), ecs.end<Velocity>());
+}
+
+TEST_P(EcsStorageTests, parallelForEachVisitsEveryComponent) {
+    ThreadPool pool(4);
+    for (int i = 0; i < 5000; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        if (i % 3 == 0) {
+            ecs.addComponent<Velocity>(e, 1.f, 2.f);
+        }
+    }
+    ecs::parallelForEach(pool, ecs::ForEachComponent<Position>(ecs),
+                         [](Position& position) { position.y += 1; });
+    auto moving = ecs.getEntitiesWithComponents<Position, Velocity>();
+    ecs::parallelForEach(pool, moving,
+                         [](Position* position, Velocity* velocity) {
+                             position->x += velocity->dx;
+                             position->y += velocity->dy;
+                         });
+    for (auto const& position : ecs::ForEachComponent<Position>(ecs)) {
+        auto i = position.getEntity().getId();
+        if (i % 3 == 0) {
+            EXPECT_EQ(3.f, position.y);
+            EXPECT_EQ(static_cast<float>(i + 1), position.x);
+        } else {
+            EXPECT_EQ(1.f, position.y);
+            EXPECT_EQ(static_cast<float>(i), position.x);
+        }
+    }
+    for (auto [begin, end] : ecs.getSegments<Position>()) {
+        auto address = reinterpret_cast<uintptr_t>(begin);
+        EXPECT_EQ(0, address % ecs::CACHE_LINE_SIZE);
+    }
+}
+
+TEST_P(EcsStorageTests, commandBufferDefersStructuralChanges) {
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 100; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        ecs.addComponent<Velocity>(e, 1.f, 0.f);
+        entities.push_back(e);
+    }
+    auto moving = ecs.getEntitiesWithComponents<Position, Velocity>();
+    ecs::CommandBuffer commands;
+    for (auto [position, velocity] : moving) {
+        auto i = position->getEntity().getId();
+        if (i % 2 == 0) {
+            commands.destroyEntity(position->getEntity());
+        } else if (i % 3 == 0) {
+            commands.removeComponent<Velocity>(position->getEntity());
+            commands.addComponent<Name>(position->getEntity(), "stopped");
+        }
+    }
+    auto spawned = commands.createEntity();
+    commands.addComponent<Position>(spawned, -1.f, -1.f);
+    commands.addComponent<Velocity>(spawned, 2.f, 2.f);
+    commands.addComponent<Name>(spawned, "spawned");
+    EXPECT_EQ(100, moving.size());
+    EXPECT_EQ(100, ecs.getCurrentEntityCount());
+
+    auto created = commands.apply(ecs);
+    EXPECT_TRUE(commands.empty());
+    ASSERT_EQ(1, created.size());
+    EXPECT_EQ(51, ecs.getCurrentEntityCount());
+    EXPECT_EQ("spawned", ecs.getComponent<Name>(created[0])->value);
+    EXPECT_EQ(-1.f, ecs.getComponent<Position>(created[0])->x);
+    EXPECT_EQ("stopped", ecs.getComponent<Name>(entities[3])->value);
+    EXPECT_EQ(nullptr, ecs.getComponent<Velocity>(entities[3]));
+    EXPECT_FALSE(ecs.exists(entities[4]));
+
+    auto updated = ecs.getEntitiesWithComponents<Position, Velocity>();
+    EXPECT_EQ(50 - 17 + 1, updated.size());
+    for (auto [position, velocity] : updated) {
+        auto e = position->getEntity();
+        ASSERT_TRUE(ecs.exists(e));
+        EXPECT_EQ(velocity, ecs.getComponent<Velocity>(e));
+    }
+}
+
+TEST_P(EcsStorageTests, bulkCreateAndRemove) {
+    auto single = ecs.createEntity();
+    ecs.addComponent<Position>(single, -1.f, -1.f);
+    auto query = ecs.getEntitiesWithComponents<Position, Name>();
+    EXPECT_EQ(0, query.size());
+
+    auto entities = ecs.createEntities<Position, Name>(
+        5000, std::tuple(1.f, 2.f), std::tuple(std::string("particle")));
+    ASSERT_EQ(5000, entities.size());
+    EXPECT_EQ(5001, ecs.getCurrentEntityCount());
+    EXPECT_EQ(5000, query.size());
+    EXPECT_EQ(2.f, ecs.getComponent<Position>(entities[4999])->y);
+    EXPECT_EQ("particle", ecs.getComponent<Name>(entities[0])->value);
+
+    std::vector<ecs::Entity> dead;
+    for (size_t i = 0; i < entities.size(); i += 2) {
+        dead.push_back(entities[i]);
+    }
+    dead.push_back(entities[0]);  // duplicates are ignored
+    ecs.removeEntities(dead);
+    EXPECT_EQ(2501, ecs.getCurrentEntityCount());
+    auto updated = ecs.getEntitiesWithComponents<Position, Name>();
+    EXPECT_EQ(2500, updated.size());
+    for (auto [position, name] : updated) {
+        auto e = position->getEntity();
+        ASSERT_TRUE(ecs.exists(e));
+        EXPECT_EQ(1.f, position->x);
+        EXPECT_EQ(name, ecs.getComponent<Name>(e));
+        EXPECT_EQ("particle", name->value);
+    }
+    EXPECT_EQ(-1.f, ecs.getComponent<Position>(single)->x);
+}
+
+TEST_P(EcsStorageTests, defragmentSortsStorageByKey) {
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 1000; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        if (i % 2 == 0) {
+            ecs.addComponent<Velocity>(e, static_cast<float>(i), 0.f);
+        }
+        entities.push_back(e);
+    }
+    auto query = ecs.getEntitiesWithComponents<Position, Velocity>();
+    // swap-removes scramble the order
+    for (int i = 0; i < 1000; i += 7) {
+        ecs.removeComponent<Position>(entities[i]);
+        ecs.addComponent<Position>(entities[i], static_cast<float>(i), 0.f);
+    }
+    // archetypes are sorted separately, every segment has to be sorted
+    ecs.defragment([](ecs::Entity const& e) { return 1000 - e.getId(); });
+    for (auto [begin, end] : ecs.getSegments<Position>()) {
+        EXPECT_TRUE(std::is_sorted(begin, end, [](auto& a, auto& b) {
+            return a.x > b.x;
+        }));
+    }
+    ecs.defragment();
+    for (auto [begin, end] : ecs.getSegments<Position>()) {
+        EXPECT_TRUE(std::is_sorted(begin, end, [](auto& a, auto& b) {
+            return a.x < b.x;
+        }));
+    }
+    for (auto const& position : ecs::ForEachComponent<Position>(ecs)) {
+        EXPECT_EQ(static_cast<float>(position.getEntity().getId()),
+                  position.x);
+    }
+    EXPECT_EQ(500, query.size());
+    for (auto [position, velocity] : query) {
+        EXPECT_EQ(position->getEntity(), velocity->getEntity());
+        EXPECT_EQ(position->x, velocity->dx);
+        EXPECT_EQ(position, ecs.getComponent<Position>(position->getEntity()));
+    }
+}
+
+TEST_P(EcsStorageTests, changeTicksFilterQueries) {
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 100; ++i) {
+        auto e = ecs.createEntity();
+        ecs.addComponent<Position>(e, static_cast<float>(i), 0.f);
+        ecs.addComponent<Velocity>(e, 0.f, 0.f);
+        entities.push_back(e);
+    }
+    auto query = ecs.getEntitiesWithComponents<Position, Velocity>();
+    ecs::Tick lastRun = 0;
+    auto since = std::exchange(lastRun, ecs::advanceTick());
+    size_t added = 0;
+    for ([[maybe_unused]] auto [position, velocity] :
+         query.filter<ecs::Added<Position>>(since)) {
+        ++added;
+    }
+    EXPECT_EQ(100, added);
+
+    // second run sees only what happened after the first one started
+    for (int i = 0; i < 100; i += 10) {
+        ecs.getComponent<Position>(entities[i])->markChanged();
+    }
+    auto late = ecs.createEntity();
+    ecs.addComponent<Position>(late, -1.f, 0.f);
+    ecs.addComponent<Velocity>(late, 0.f, 0.f);
+    ecs.removeComponent<Velocity>(entities[1]);  // moves other components
+    since = std::exchange(lastRun, ecs::advanceTick());
+    std::vector<float> changed;
+    for (auto [position, velocity] :
+         query.filter<ecs::Changed<Position>>(since)) {
+        changed.push_back(position->x);
+    }
+    std::sort(changed.begin(), changed.end());
+    std::vector<float> expected = {-1, 0, 10, 20, 30, 40, 50, 60, 70, 80, 90};
+    EXPECT_EQ(expected, changed);
+    size_t newlyAdded = 0;
+    for (auto [position, velocity] :
+         query.filter<ecs::Added<Position>, ecs::Added<Velocity>>(since)) {
+        EXPECT_EQ(late, position->getEntity());
+        ++newlyAdded;
+    }
+    EXPECT_EQ(1, newlyAdded);
+
+    since = std::exchange(lastRun, ecs::advanceTick());
+    auto filtered = query.filter<ecs::Changed<Velocity>>(since);
+    EXPECT_EQ(filtered.end(), filtered.begin());
+}
+
+TEST_P(EcsStorageTests, removedEntityIdIsReused) {
+    auto a = ecs.createEntity();
+    ecs.addComponent<Position>(a, 1.f, 1.f);
+    ecs.addComponent<Name>(a, "a");
+    ecs.removeEntity(a);
+    EXPECT_FALSE(ecs.exists(a));
+    EXPECT_EQ(0, ecs.getCurrentEntityCount());
+
+    auto b = ecs.createEntity();
+    EXPECT_EQ(a.getId(), b.getId());
+    EXPECT_NE(a, b);
+    EXPECT_EQ(nullptr, ecs.getComponent<Position>(b));
+    ecs.addComponent<Position>(b, 2.f, 2.f);
+    EXPECT_EQ(2.f, ecs.getComponent<Position>(b)->x);
+}
+
+TEST_P(EcsStorageTests, snapshotRestoresEntitiesAndComponents) {
+    ecs::EcsContainer world{ecs::ComponentTags{}, GetParam()};
+    auto root = world.createEntity();
+    world.addComponent<Transform2D>(root);
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 100; ++i) {
+        auto e = world.createEntity();
+        world.addComponent<Transform2D>(e)->setPosition(
+            {static_cast<float>(i), 1.f});
+        if (i % 2 == 0) {
+            world.addComponent<Hierarchy2D>(e, root);
+        }
+        entities.push_back(e);
+    }
+    world.removeEntity(entities[3]);
+    auto path = ::testing::TempDir() + "world.snapshot";
+    ecs::WorldSnapshot::save<Transform2D, Hierarchy2D>(world, path);
+
+    // loads into the other storage mode as well
+    ecs::EcsContainer loaded{ecs::ComponentTags{},
+                             GetParam() == ecs::StorageMode::COMPONENT_ARRAYS
+                                 ? ecs::StorageMode::ARCHETYPE_CHUNKS
+                                 : ecs::StorageMode::COMPONENT_ARRAYS};
+    ecs::WorldSnapshot::load<Transform2D, Hierarchy2D>(loaded, path);
+    std::remove(path.c_str());
+    EXPECT_EQ(100u, loaded.getCurrentEntityCount());
+    EXPECT_FALSE(loaded.exists(entities[3]));
+    for (int i = 0; i < 100; ++i) {
+        if (i == 3) {
+            continue;
+        }
+        auto* transform = loaded.getComponent<Transform2D>(entities[i]);
+        ASSERT_NE(nullptr, transform);
+        EXPECT_EQ(static_cast<float>(i), transform->getX());
+        EXPECT_EQ(entities[i], transform->getEntity());
+        auto* hierarchy = loaded.getComponent<Hierarchy2D>(entities[i]);
+        ASSERT_EQ(i % 2 == 0, hierarchy != nullptr);
+        if (hierarchy) {
+            EXPECT_EQ(root, hierarchy->getParent());
+        }
+    }
+    EXPECT_EQ(50u, (loaded.getEntitiesWithComponents<Transform2D,
+                                                     Hierarchy2D>().size()));
+    // the free slot is reused with the next generation
+    auto reused = loaded.createEntity();
+    EXPECT_EQ(entities[3].getId(), reused.getId());
+    EXPECT_NE(entities[3], reused);
+    EXPECT_THROW((ecs::WorldSnapshot::load<Transform2D>(loaded, path)),
+                 std::runtime_error);
+}
+
+TEST_P(EcsStorageTests, snapshotIsCheckedBeforeTheContainerIsTouched) {
+    ecs::EcsContainer world{ecs::ComponentTags{}, GetParam()};
+    auto kept = world.createEntity();
+    auto removed = world.createEntity();
+    world.addComponent<Transform2D>(kept)->setPosition({2.f, 3.f});
+    world.removeEntity(removed);
+    auto path = ::testing::TempDir() + "owners.snapshot";
+    ecs::WorldSnapshot::save<Transform2D>(world, path);
+    std::string bytes;
+    {
+        std::ifstream in(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), {});
+    }
+    auto rewrite = [&] {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), bytes.size());
+    };
+    // a 48 byte header and 2 slots come before the column table, whose
+    // owners and data offsets are its fifth and sixth words
+    auto column = 48 + 2 * sizeof(ecs::Entity);
+    uint64_t ownersOffset = 0;
+    uint64_t dataOffset = 0;
+    std::memcpy(&ownersOffset, bytes.data() + column + 32, 8);
+    std::memcpy(&dataOffset, bytes.data() + column + 40, 8);
+
+    // the vtable pointer is not read back
+    std::memset(bytes.data() + dataOffset, 0xab, sizeof(void*));
+    rewrite();
+    ecs::EcsContainer loaded{ecs::ComponentTags{}, GetParam()};
+    ecs::WorldSnapshot::load<Transform2D>(loaded, path);
+    ASSERT_NE(nullptr, loaded.getComponent<Transform2D>(kept));
+    EXPECT_EQ(2.f, loaded.getComponent<Transform2D>(kept)->getX());
+
+    // a removed owner is rejected before any entity is restored
+    std::memcpy(bytes.data() + ownersOffset, &removed, sizeof(removed));
+    rewrite();
+    ecs::EcsContainer broken{ecs::ComponentTags{}, GetParam()};
+    EXPECT_THROW((ecs::WorldSnapshot::load<Transform2D>(broken, path)),
+                 std::runtime_error);
+    EXPECT_EQ(0u, broken.getMaximumEntityCount());
+    std::remove(path.c_str());
+}
+
+TEST_P(EcsStorageTests, rollbackCopiesOnlyChangedPages) {
+    using Rollback = ecs::RollbackBuffer<Velocity>;
+    std::vector<ecs::Entity> entities;
+    for (size_t i = 0; i < 4 * Rollback::PAGE_SIZE; ++i) {
+        entities.push_back(ecs.createEntity());
+        ecs.addComponent<Velocity>(entities.back(), static_cast<float>(i), 0.f);
+    }
+    Rollback rollback(3);
+    rollback.capture(ecs);
+    EXPECT_EQ(4u, rollback.getCopiedPageCount());
+
+    ecs.getComponent<Velocity>(entities[5])->dy = 1.f;
+    rollback.capture(ecs);
+    EXPECT_EQ(1u, rollback.getCopiedPageCount());
+
+    ecs.removeComponent<Velocity>(entities[200]);
+    ecs.getComponent<Velocity>(entities[5])->dy = 2.f;
+    rollback.capture(ecs);
+    EXPECT_EQ(2u, rollback.getCopiedPageCount());
+    rollback.capture(ecs);
+    EXPECT_EQ(0u, rollback.getCopiedPageCount());
+    EXPECT_EQ(3u, rollback.size());
+
+    ecs.getComponent<Velocity>(entities[100])->dx = -1.f;
+    rollback.restore(ecs, 2);
+    EXPECT_EQ(1u, rollback.size());
+    EXPECT_EQ(1.f, ecs.getComponent<Velocity>(entities[5])->dy);
+    EXPECT_EQ(100.f, ecs.getComponent<Velocity>(entities[100])->dx);
+    EXPECT_EQ(entities[5],
+              ecs.getComponent<Velocity>(entities[5])->getEntity());
+    // removed components are not brought back
+    EXPECT_EQ(nullptr, ecs.getComponent<Velocity>(entities[200]));
+    EXPECT_THROW(rollback.restore(ecs, 1), std::runtime_error);
+}
+
+TEST_P(EcsStorageTests, memoryUsageIsReportedPerType) {
+    auto first = ecs.createEntity();
+    auto* velocity = ecs.addComponent<Velocity>(first, 1.f, 2.f);
+    for (int i = 0; i < 999; ++i) {
+        ecs.addComponent<Velocity>(ecs.createEntity(), 0.f, 0.f);
+    }
+    if (GetParam() == ecs::StorageMode::ARCHETYPE_CHUNKS) {
+        // chunks never move when the storage grows
+        EXPECT_EQ(velocity, ecs.getComponent<Velocity>(first));
+    }
+    auto usage = ecs.getMemoryUsage();
+    ASSERT_EQ(3u, usage.size());
+    auto const& velocities = usage[ecs::getComponentId<Velocity>()];
+    EXPECT_EQ(1000u, velocities.count);
+    EXPECT_EQ(1000 * sizeof(Velocity), velocities.usedBytes);
+    EXPECT_GE(velocities.reservedBytes, velocities.usedBytes);
+    EXPECT_EQ(0u, usage[ecs::getComponentId<Name>()].reservedBytes);
+}
+
+TEST(EntityTests, handlesArePackedAndIdsStayDense) {
+    static_assert(sizeof(ecs::Entity) == sizeof(ecs::EntityHandle));
+    ecs::Entity packed(5, 3);
+    EXPECT_EQ(5, packed.getId());
+    EXPECT_EQ(3, packed.getVersion());
+    EXPECT_NE(ecs::Entity(), packed);
+
+    ecs::EcsContainer ecs{TestTags{}};
+    std::vector<ecs::Entity> entities;
+    for (int i = 0; i < 8; ++i) {
+        entities.push_back(ecs.createEntity());
+    }
+    ecs.removeEntity(entities[2]);
+    ecs.removeEntity(entities[6]);
+    auto a = ecs.createEntity();
+    auto b = ecs.createEntity();
+    EXPECT_EQ(6, a.getId());
+    EXPECT_EQ(2, b.getId());
+    EXPECT_EQ(1, a.getVersion());
+    EXPECT_EQ(8, ecs.getMaximumEntityCount());
+    EXPECT_FALSE(ecs.exists(entities[2]));
+    EXPECT_TRUE(ecs.exists(b));
+}
+
+TEST(EventBusTests, eventsAreReadableForOneFrameAfterSwap) {
+    struct Hit {
+        int damage;
+    };
+    struct Died {
+        ecs::Entity entity;
+    };
+    ecs::EventBus events;
+    events.send(Hit{1});
+    events.send(Hit{2});
+    EXPECT_TRUE(events.read<Hit>().empty());
+    events.swap();
+    events.send(Hit{3});
+    events.send(Died{ecs::Entity(4, 0)});
+    ASSERT_EQ(2, events.read<Hit>().size());
+    EXPECT_EQ(2, events.read<Hit>()[1].damage);
+    EXPECT_TRUE(events.read<Died>().empty());
+    events.swap();
+    ASSERT_EQ(1, events.read<Hit>().size());
+    EXPECT_EQ(3, events.read<Hit>()[0].damage);
+    EXPECT_EQ(4, events.read<Died>()[0].entity.getId());
+    events.swap();
+    EXPECT_TRUE(events.read<Hit>().empty());
+    EXPECT_TRUE(events.read<Died>().empty());
+}
+
+TEST(EventBusTests, contactDamageRepeatsAfterCooldownWhileTouching) {
+    ecs::EcsContainer ecs{ecs::ComponentTags{}};
+    ecs::EventBus events;
+    ecs::HealthBarSystem health;
+    auto source = ecs.createEntity();
+    auto target = ecs.createEntity();
+    DamageRange damage{10, 10, 20};
+    auto* hp = ecs.addComponent<HealthBar>(target, 1000.f, 0.f);
+    auto frame = [&] {
+        events.swap();
+        health.applyDamage(ecs, events);
+    };
+    auto waitCooldown = [] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    };
+
+    events.send(ecs::CollisionBegan{source, target, 0, 0, {}, damage, {}});
+    frame();
+    EXPECT_EQ(990, hp->getCurrentValue());
+    frame();
+    EXPECT_EQ(990, hp->getCurrentValue());
+    waitCooldown();
+    frame();
+    EXPECT_EQ(980, hp->getCurrentValue());
+    // no more hits once the contact ended
+    events.send(ecs::CollisionEnded{source, target, 0, 0});
+    frame();
+    waitCooldown();
+    frame();
+    EXPECT_EQ(980, hp->getCurrentValue());
+    events.send(ecs::CollisionBegan{source, target, 0, 0, {}, damage, {}});
+    frame();
+    EXPECT_EQ(970, hp->getCurrentValue());
+}
+
+TEST(ChunkArenaTests, blocksAreAlignedAndReused) {
+    constexpr auto CHUNK = ecs::ARCHETYPE_CHUNK_SIZE;
+    ecs::ChunkArena arena(false);
+    auto* a = arena.allocate(100);
+    auto* b = arena.allocate(3 * CHUNK);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(a) % CHUNK);
+    EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(b) % CHUNK);
+    EXPECT_EQ(5 * CHUNK, arena.getUsedBytes());
+    EXPECT_EQ(ecs::ChunkArena::PAGE_SIZE, arena.getReservedBytes());
+    arena.deallocate(a, 100);
+    EXPECT_EQ(a, arena.allocate(CHUNK));
+    arena.allocate(2 * ecs::ChunkArena::PAGE_SIZE);
+    EXPECT_EQ(3 * ecs::ChunkArena::PAGE_SIZE, arena.getReservedBytes());
+}
+
+TEST(PairBufferTests, pairsAreSortedAndUnique) {
+    ecs::PairBuffer pairs;
+    for (uint32_t round = 0; round < 3; ++round) {
+        for (uint32_t i = 0; i < 300; ++i) {
+            pairs.add(i % 2 ? 299 - i : 70000 + i, i);
+            pairs.add(i, i % 2 ? 299 - i : 70000 + i);
+        }
+    }
+    pairs.finalize();
+    ASSERT_EQ(300, pairs.size());
+    for (size_t i = 1; i < pairs.size(); ++i) {
+        EXPECT_LT(pairs.getKeys()[i - 1], pairs.getKeys()[i]);
+    }
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 299), pairs[0]);
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 70000), pairs[1]);
+    EXPECT_EQ(ecs::PairBuffer::Pair(298, 70298), pairs[299]);
+    pairs.clear();
+    EXPECT_TRUE(pairs.empty());
+}
+
+TEST(AabbTreeTests, queriesMatchBruteForceAfterMoves) {
+    std::mt19937 random(7);
+    std::uniform_real_distribution<scalar_t> position(-50, 50);
+    std::uniform_real_distribution<scalar_t> size(0.1f, 4);
+    auto randomBox = [&] {
+        auto x = position(random);
+        auto y = position(random);
+        return ecs::Aabb{x, y, x + size(random), y + size(random)};
+    };
+    ecs::AabbTree tree(0.5f);
+    std::vector<ecs::Aabb> boxes;
+    std::vector<int> proxies;
+    for (uint32_t i = 0; i < 500; ++i) {
+        boxes.emplace_back(randomBox());
+        proxies.emplace_back(tree.insert(boxes.back(), i));
+    }
+    for (uint32_t i = 0; i < 500; i += 3) {
+        boxes[i] = randomBox();
+        tree.move(proxies[i], boxes[i]);
+    }
+    for (uint32_t i = 1; i < 500; i += 5) {
+        tree.remove(proxies[i]);
+    }
+    EXPECT_EQ(400, tree.size());
+    EXPECT_LE(tree.getHeight(), 20);
+    for (uint32_t i = 0; i < 500; i += 7) {
+        std::vector<bool> found(500);
+        tree.query(boxes[i], [&](uint32_t other) { found[other] = true; });
+        for (uint32_t j = 0; j < 500; ++j) {
+            if (j % 5 == 1) {
+                EXPECT_FALSE(found[j]);
+            } else if (boxes[i].overlaps(boxes[j])) {
+                EXPECT_TRUE(found[j]);
+            }
+        }
+    }
+}
+
+TEST(BroadPhaseTests, gridAndTreeFindEveryOverlap) {
+    std::mt19937 random(11);
+    std::uniform_real_distribution<scalar_t> position(-45, 45);
+    std::uniform_real_distribution<scalar_t> size(0.2f, 3);
+    std::vector<ecs::Entity> bodies;
+    std::vector<Vec4> boxes;
+    for (ecs::EntityId i = 0; i < 300; ++i) {
+        bodies.emplace_back(i, 0);
+        boxes.emplace_back(Vec4({position(random), position(random),
+                                 size(random), size(random)}));
+    }
+    // outside of the grid
+    bodies.emplace_back(300, 0);
+    boxes.emplace_back(Vec4({500, 500, 2, 2}));
+    bodies.emplace_back(301, 0);
+    boxes.emplace_back(Vec4({501, 501, 2, 2}));
+    ecs::GridBroadPhase grid(Vec2{100, 100});
+    ecs::TreeBroadPhase tree;
+    ecs::PairBuffer gridPairs;
+    ecs::PairBuffer treePairs;
+    for (int frame = 0; frame < 3; ++frame) {
+        for (size_t i = 0; i < 300; i += 4) {
+            boxes[i][0] += 0.3f;
+        }
+        grid.findPairs(boxes, gridPairs);
+        tree.findPairs(bodies, boxes, treePairs);
+        auto gridKeys = gridPairs.getKeys();
+        auto treeKeys = treePairs.getKeys();
+        for (uint32_t a = 0; a < 300; ++a) {
+            auto boxA = ecs::Aabb::fromBoundingBox(boxes[a]);
+            for (uint32_t b = a + 1; b < 300; ++b) {
+                if (boxA.overlaps(ecs::Aabb::fromBoundingBox(boxes[b]))) {
+                    auto key = ecs::PairBuffer::pack(a, b);
+                    EXPECT_TRUE(std::binary_search(gridKeys.begin(),
+                                                   gridKeys.end(), key));
+                    EXPECT_TRUE(std::binary_search(treeKeys.begin(),
+                                                   treeKeys.end(), key));
+                }
+            }
+        }
+        EXPECT_EQ(ecs::PairBuffer::Pair(300, 301),
+                  treePairs[treePairs.size() - 1]);
+    }
+    EXPECT_EQ(302, tree.getTree().size());
+    // a reused id replaces the proxy of the destroyed entity
+    bodies.resize(2);
+    boxes.resize(2);
+    bodies[1] = ecs::Entity(bodies[1].getId(), 1);
+    tree.findPairs(bodies, boxes, treePairs);
+    EXPECT_EQ(2, tree.getTree().size());
+}
+
+TEST(BroadPhaseTests, sweepAndPruneReportsPairDeltas) {
+    std::mt19937 random(5);
+    std::uniform_real_distribution<scalar_t> position(-20, 20);
+    std::uniform_real_distribution<scalar_t> step(-0.5f, 0.5f);
+    std::vector<ecs::Entity> bodies;
+    std::vector<Vec4> boxes;
+    for (ecs::EntityId i = 0; i < 200; ++i) {
+        bodies.emplace_back(i, 0);
+        boxes.emplace_back(Vec4({position(random), position(random), 2, 2}));
+    }
+    auto overlapping = [&] {
+        std::set<std::pair<ecs::EntityHandle, ecs::EntityHandle>> pairs;
+        for (size_t a = 0; a < boxes.size(); ++a) {
+            auto boxA = ecs::Aabb::fromBoundingBox(boxes[a]);
+            for (size_t b = a + 1; b < boxes.size(); ++b) {
+                if (boxA.overlaps(ecs::Aabb::fromBoundingBox(boxes[b]))) {
+                    pairs.emplace(std::minmax(bodies[a].getHandle(),
+                                              bodies[b].getHandle()));
+                }
+            }
+        }
+        return pairs;
+    };
+    ecs::SweepAndPruneBroadPhase sweepAndPrune;
+    ecs::PairBuffer pairs;
+    std::set<std::pair<ecs::EntityHandle, ecs::EntityHandle>> tracked;
+    for (int frame = 0; frame < 20; ++frame) {
+        for (auto& box : boxes) {
+            box[0] += step(random);
+            box[1] += step(random);
+        }
+        if (frame == 10) {
+            // destroy a body, reuse the id of another and add a new one
+            bodies.erase(bodies.begin() + 3);
+            boxes.erase(boxes.begin() + 3);
+            bodies[7] = ecs::Entity(bodies[7].getId(), 1);
+            bodies.emplace_back(200, 0);
+            boxes.emplace_back(boxes[0]);
+        }
+        sweepAndPrune.findPairs(bodies, boxes, pairs);
+        for (auto [a, b] : sweepAndPrune.getRemovedPairs()) {
+            EXPECT_EQ(1, tracked.erase(std::minmax(a.getHandle(),
+                                                   b.getHandle())));
+        }
+        for (auto [a, b] : sweepAndPrune.getAddedPairs()) {
+            EXPECT_TRUE(
+                tracked.emplace(std::minmax(a.getHandle(), b.getHandle()))
+                    .second);
+        }
+        auto expected = overlapping();
+        EXPECT_EQ(expected, tracked);
+        ASSERT_EQ(expected.size(), pairs.size());
+        for (size_t i = 0; i < pairs.size(); ++i) {
+            auto [a, b] = pairs[i];
+            EXPECT_TRUE(expected.contains(std::minmax(
+                bodies[a].getHandle(), bodies[b].getHandle())));
+        }
+    }
+
+    // boxes resting edge to edge overlap, whichever side comes to a stop
+    ecs::SweepAndPruneBroadPhase edges;
+    std::vector<ecs::Entity> pair{ecs::Entity(0, 0), ecs::Entity(1, 0)};
+    std::vector<Vec4> pairBoxes{Vec4({0, 0, 1, 1}), Vec4({3, 0, 1, 1})};
+    edges.findPairs(pair, pairBoxes, pairs);
+    EXPECT_TRUE(pairs.empty());
+    pairBoxes[1][0] = 1;
+    edges.findPairs(pair, pairBoxes, pairs);
+    EXPECT_EQ(1u, pairs.size());
+    EXPECT_EQ(1u, edges.getAddedPairs().size());
+    pairBoxes[1][0] = -3;
+    edges.findPairs(pair, pairBoxes, pairs);
+    EXPECT_TRUE(pairs.empty());
+    pairBoxes[1][0] = -1;
+    edges.findPairs(pair, pairBoxes, pairs);
+    EXPECT_EQ(1u, pairs.size());
+    EXPECT_EQ(1u, edges.getAddedPairs().size());
+}
+
+TEST(BroadPhaseTests, staticBodiesAreBuiltOnceAndPairedWithMovingOnes) {
+    // three overlapping platforms in a row
+    std::vector<ecs::Entity> platforms{ecs::Entity(0, 0), ecs::Entity(1, 0),
+                                       ecs::Entity(2, 0)};
+    std::vector<Vec4> platformBoxes{Vec4({0, 0, 4, 1}), Vec4({3, 0, 4, 1}),
+                                    Vec4({6, 0, 4, 1})};
+    std::vector<Vec4> moving{Vec4({3.5f, 0.5f, 1, 1}), Vec4({50, 50, 1, 1})};
+    ecs::StaticBroadPhase staticWorld;
+    ecs::PairBuffer pairs;
+    auto update = [&](size_t platformCount, size_t changed) {
+        pairs.clear();
+        staticWorld.beginFrame();
+        for (size_t i = 0; i < platformCount; ++i) {
+            staticWorld.addBody(platforms[i], i == changed,
+                                [&] { return platformBoxes[i]; });
+        }
+        staticWorld.findPairs(moving, pairs);
+        pairs.finalize();
+    };
+    update(3, 0);
+    EXPECT_EQ(3, staticWorld.getRefreshedCount());
+    ASSERT_EQ(2, pairs.size());
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 2), pairs[0]);
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 3), pairs[1]);
+    EXPECT_EQ(platforms[1], staticWorld.getBodies()[1]);
+
+    moving[0][0] = 6.5f;
+    update(3, 3);
+    EXPECT_EQ(0, staticWorld.getRefreshedCount());
+    ASSERT_EQ(2, pairs.size());
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 3), pairs[0]);
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 4), pairs[1]);
+
+    // the last platform is gone, the first one moved under the body
+    platformBoxes[0][0] = 6;
+    update(2, 0);
+    EXPECT_EQ(1, staticWorld.getRefreshedCount());
+    ASSERT_EQ(2, pairs.size());
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 2), pairs[0]);
+    EXPECT_EQ(ecs::PairBuffer::Pair(0, 3), pairs[1]);
+}
+
+TEST(CollisionTests, parallelNarrowPhaseMatchesSerialRun) {
+    // a pile of boxes and circles falling on a floor
+    auto simulate = [](ThreadPool* pool) {
+        ecs::EcsContainer ecs{ecs::ComponentTags{}};
+        ecs::EventBus events;
+        ecs::PhysicsSystem physics;
+        ecs::CollisionSystem2D collisions(Vec2{100, 100});
+        if (pool) {
+            collisions.setThreadPool(*pool);
+        }
+        auto floor = ecs.createEntity();
+        ecs.addComponent<Transform2D>(floor)->setPosition({0, -6});
+        ecs.addComponent<Physics2D>(floor)->setStatic(true);
+        ecs.addComponent<Collider2D>(floor)->add<BoxCollider>(
+            20, 1, ColliderType::PHYSICS);
+        std::mt19937 random(3);
+        std::uniform_real_distribution<scalar_t> position(-4, 4);
+        std::vector<ecs::Entity> entities;
+        for (int i = 0; i < 300; ++i) {
+            auto e = ecs.createEntity();
+            ecs.addComponent<Transform2D>(e)->setPosition(
+                {position(random), position(random)});
+            ecs.addComponent<Physics2D>(e);
+            auto* collider = ecs.addComponent<Collider2D>(e);
+            if (i % 3 == 0) {
+                collider->add<CircleCollider>(0.4f, ColliderType::PHYSICS);
+            } else {
+                collider->add<BoxCollider>(0.8f, 0.6f, ColliderType::PHYSICS);
+            }
+            entities.push_back(e);
+        }
+        size_t began = 0;
+        size_t ended = 0;
+        for (int frame = 0; frame < 20; ++frame) {
+            physics.update(collisions, ecs, 1 / 60.f);
+            collisions.checkCollisions(ecs, events, 1 / 60.f);
+            events.swap();
+            began += events.read<ecs::CollisionBegan>().size();
+            ended += events.read<ecs::CollisionEnded>().size();
+        }
+        EXPECT_LE(ended, began);
+        std::vector<scalar_t> state{static_cast<scalar_t>(began),
+                                    static_cast<scalar_t>(ended)};
+        for (auto e : entities) {
+            auto p = ecs.getComponent<Transform2D>(e)->getPosition();
+            auto v = ecs.getComponent<Physics2D>(e)->getLinearVelocity();
+            state.insert(state.end(), {p[0], p[1], v[0], v[1]});
+        }
+        return state;
+    };
+    ThreadPool pool(4);
+    auto serial = simulate(nullptr);
+    EXPECT_GT(serial[0], 300);
+    EXPECT_EQ(serial, simulate(&pool));
+}
+
+TEST(SparseIndexTests, pagesAreReleasedWhenEmpty) {
+    ecs::SparseIndex index;
+    EXPECT_EQ(ecs::SparseIndex::INVALID_INDEX, index.get(1'000'000));
+    index.set(3, 0);
+    index.set(1'000'000, 1);
+    EXPECT_EQ(2, index.pageCount());
+    EXPECT_EQ(1, index.get(1'000'000));
+    index.erase(1'000'000);
+    EXPECT_EQ(1, index.pageCount());
+    EXPECT_EQ(ecs::SparseIndex::INVALID_INDEX, index.get(1'000'000));
+    EXPECT_EQ(0, index.get(3));
+}
+
+TEST(SignatureTests, bitsAboveFirstWord) {
+    using Sig = ecs::Signature<256>;
+    auto sig = Sig::bit(3) | Sig::bit(100) | Sig::bit(255);
+    std::vector<size_t> ids(sig.begin(), sig.end());
+    EXPECT_EQ((std::vector<size_t>{3, 100, 255}), ids);
+    EXPECT_EQ(3, sig.count());
+    EXPECT_TRUE(sig.contains(Sig::bit(100) | Sig::bit(255)));
+    EXPECT_FALSE(sig.contains(Sig::bit(100) | Sig::bit(101)));
+    EXPECT_TRUE(sig.intersects(Sig::bit(255)));
+    EXPECT_FALSE(sig.intersects(Sig::bit(254)));
+    sig.reset(3);
+    EXPECT_EQ(100, sig.first());
+    EXPECT_TRUE(Sig::all().contains(sig));
+    EXPECT_EQ(256, Sig().first());
+    EXPECT_EQ(Sig().begin(), Sig().end());
+}
+
+TEST(ThreadPoolTests, parallelForCoversRangeOnce) {
+    ThreadPool pool(3);
+    std::vector<std::atomic<int>> hits(10007);
+    pool.parallelFor(hits.size(), 64, [&](size_t begin, size_t end) {
+        for (auto i = begin; i < end; ++i) {
+            ++hits[i];
+        }
+    });
+    for (auto const& hit : hits) {
+        ASSERT_EQ(1, hit);
+    }
+}
+
+TEST(ThreadPoolTests, nestedParallelForDoesNotBlockWorkers) {
+    ThreadPool pool(2);
+    std::atomic<int> sum = 0;
+    pool.parallelFor(8, 1, [&](size_t, size_t) {
+        pool.parallelFor(100, 10, [&](size_t begin, size_t end) {
+            sum += static_cast<int>(end - begin);
+        });
+    });
+    EXPECT_EQ(800, sum);
+}
+
+TEST(SystemSchedulerTests, conflictingSystemsKeepRegistrationOrder) {
+    ThreadPool pool(4);
+    ecs::SystemScheduler scheduler(pool);
+    std::vector<int> order;
+    std::mutex orderMutex;
+    auto record = [&](int id) {
+        return [&, id](scalar_t) {
+            std::lock_guard lock(orderMutex);
+            order.push_back(id);
+        };
+    };
+    auto move = scheduler.addSystem(
+        "move", ecs::writes<Position>(ecs::reads<Velocity>()), record(0));
+    auto accelerate =
+        scheduler.addSystem("accelerate", ecs::writes<Velocity>(), record(1));
+    auto names = scheduler.addSystem("names", ecs::writes<Name>(), record(2));
+    auto cleanup =
+        scheduler.addSystem("cleanup", ecs::exclusive(), record(3));
+
+    EXPECT_EQ(std::vector<size_t>{move}, scheduler.getDependencies(accelerate));
+    EXPECT_TRUE(scheduler.getDependencies(names).empty());
+    EXPECT_EQ((std::vector<size_t>{move, accelerate, names}),
+              scheduler.getDependencies(cleanup));
+
+    for (int frame = 0; frame < 100; ++frame) {
+        order.clear();
+        scheduler.run(0.016f);
+        ASSERT_EQ(4, order.size());
+        auto position = [&](int id) {
+            return std::find(order.begin(), order.end(), id) - order.begin();
+        };
+        EXPECT_LT(position(0), position(1));
+        EXPECT_EQ(3, position(3));
+    }
+}
+
+TEST(SystemSchedulerTests, healthRunsNextToTheEngineSystems) {
+    ThreadPool pool(2);
+    ecs::SystemScheduler scheduler(pool);
+    std::atomic<bool> healthStarted = false;
+    std::atomic<bool> sawHealth = false;
+    // ai waits a while for health to start, both are ready at once
+    auto ai = scheduler.addSystem(
+        "ai", ecs::AiSystem::getAccess(), [&](scalar_t) {
+            for (int i = 0; i < 1000 && !healthStarted; ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            sawHealth = healthStarted.load();
+        });
+    auto physics = scheduler.addSystem(
+        "physics", ecs::PhysicsSystem::getAccess(), [](scalar_t) {});
+    auto hierarchy = scheduler.addSystem(
+        "hierarchy", ecs::HierarchySystem::getAccess(), [](scalar_t) {});
+    auto collision = scheduler.addSystem(
+        "collision", ecs::CollisionSystem2D::getAccess(), [](scalar_t) {});
+    auto health = scheduler.addSystem(
+        "health", ecs::HealthBarSystem::getAccess(),
+        [&](scalar_t) { healthStarted = true; });
+
+    EXPECT_EQ(std::vector<size_t>{ai}, scheduler.getDependencies(physics));
+    EXPECT_EQ((std::vector<size_t>{ai, physics}),
+              scheduler.getDependencies(hierarchy));
+    EXPECT_EQ((std::vector<size_t>{ai, physics, hierarchy}),
+              scheduler.getDependencies(collision));
+    EXPECT_TRUE(scheduler.getDependencies(health).empty());
+    scheduler.run(0.016f);
+    EXPECT_TRUE(sawHealth);
+}
+
+TEST(SystemSchedulerTests, exceptionIsRethrownAfterFrame) {
+    ThreadPool pool(2);
+    ecs::SystemScheduler scheduler(pool);
+    std::atomic<int> runs = 0;
+    scheduler.addSystem("fails", ecs::writes<Position>(), [](scalar_t) {
+        throw std::runtime_error("system failed");
+    });
+    scheduler.addSystem("reads", ecs::reads<Position>(),
+                        [&](scalar_t) { ++runs; });
+    EXPECT_THROW(scheduler.run(0), std::runtime_error);
+    EXPECT_EQ(1, runs);
+    EXPECT_THROW(scheduler.run(0), std::runtime_error);
+    EXPECT_EQ(2, runs);
+}
+
+TEST(HierarchyTests, childrenFollowParentsAndSkipCleanSubtrees) {
+    ecs::EcsContainer ecs{ecs::ComponentTags{}};
+    auto root = ecs.createEntity();
+    auto child = ecs.createEntity();
+    auto grandchild = ecs.createEntity();
+    ecs.addComponent<Transform2D>(root);
+    ecs.addComponent<Transform2D>(child);
+    ecs.addComponent<Transform2D>(grandchild);
+    ecs.addComponent<Hierarchy2D>(grandchild, child);
+    ecs.addComponent<Hierarchy2D>(child, root);
+    ecs.getComponent<Transform2D>(root)->setPosition({1, 0});
+    ecs.getComponent<Transform2D>(child)->setPosition({2, 0});
+    ecs.getComponent<Transform2D>(grandchild)->setPosition({0, 1});
+
+    ecs::HierarchySystem hierarchy;
+    hierarchy.update(ecs);
+    auto* leaf = ecs.getComponent<Transform2D>(grandchild);
+    EXPECT_FLOAT_EQ(3.f, leaf->modelToWorld()(0, 3));
+    EXPECT_FLOAT_EQ(1.f, leaf->modelToWorld()(1, 3));
+    EXPECT_EQ(2u, ecs.getComponent<Hierarchy2D>(grandchild)->getDepth());
+
+    auto changed = leaf->getChangedTick();
+    hierarchy.update(ecs);
+    EXPECT_EQ(changed, leaf->getChangedTick());
+
+    ecs.getComponent<Transform2D>(root)->translate({0, 5});
+    hierarchy.update(ecs);
+    EXPECT_FLOAT_EQ(6.f, leaf->modelToWorld()(1, 3));
+
+    ecs.removeEntity(root);
+    hierarchy.update(ecs);
+    leaf = ecs.getComponent<Transform2D>(grandchild);
+    EXPECT_FLOAT_EQ(2.f, leaf->modelToWorld()(0, 3));
+    EXPECT_FLOAT_EQ(1.f, leaf->modelToWorld()(1, 3));
+}
+
+INSTANTIATE_TEST_SUITE_P(StorageModes, EcsStorageTests,
+                         ::testing::Values(ecs::StorageMode::COMPONENT_ARRAYS,
+                                           ecs::StorageMode::ARCHETYPE_CHUNKS));